@@ -286,6 +286,23 @@ size_t mbstrlen(const char *pointer)
 	return count;
 }
 
+/* Return the number of (multibyte) characters in the first maxlen bytes
+ * of the given string, or in the whole string when it is shorter. */
+size_t mbstrnlen(const char *pointer, size_t maxlen)
+{
+	size_t count = 0;
+
+	while (maxlen > 0 && *pointer != '\0') {
+		size_t length = char_length(pointer);
+
+		pointer += length;
+		maxlen -= (length < maxlen) ? length : maxlen;
+		count++;
+	}
+
+	return count;
+}
+
 /* Parse a multibyte character from buf.  Return the number of bytes
  * used.  If chr isn't NULL, store the multibyte character in it.  If
  * col isn't NULL, add the character's width (in columns) to it. */
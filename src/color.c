@@ -272,6 +272,12 @@ void set_up_multicache(linestruct *line)
 {
 	line->multidata = (short *)nmalloc(openfile->syntax->nmultis * sizeof(short));
 
+#ifndef NANO_TINY
+	/* The cache lives on the heap, so the lines must be gone through. */
+	if (openfile->arena != NULL)
+		openfile->arena->pristine = FALSE;
+#endif
+
 	for (int index = 0; index < openfile->syntax->nmultis; index++)
 		line->multidata[index] = -1;
 }
@@ -323,9 +329,26 @@ void check_the_multis(linestruct *line)
 	}
 }
 
+/* Throw away the multi-line regex info of the given line and all lines
+ * after it, so that it will be recomputed when needed. */
+void discard_multicolorinfo(linestruct *line)
+{
+	for (; line != NULL; line = line->next) {
+		free(line->multidata);
+		line->multidata = NULL;
+	}
+}
+
 /* Precalculate the multi-line start and end regex info so we can
  * speed up rendering (with any hope at all...). */
 void precalc_multicolorinfo(void)
+{
+	precalc_multicolorinfo_from(openfile->filetop);
+}
+
+/* Compute the multi-line regex info for the given line and the lines after
+ * it, assuming that the info for the lines before it is up to date. */
+void precalc_multicolorinfo_from(linestruct *first)
 {
 	const colortype *ink;
 	regmatch_t startmatch, endmatch;
@@ -335,22 +358,33 @@ void precalc_multicolorinfo(void)
 		return;
 
 	/* For each line, allocate cache space for the multiline-regex info. */
-	for (line = openfile->filetop; line != NULL; line = line->next)
-		set_up_multicache(line);
+	for (line = first; line != NULL; line = line->next)
+		if (line->multidata == NULL)
+			set_up_multicache(line);
 
 	for (ink = openfile->colorstrings; ink != NULL; ink = ink->next) {
 		/* If this is not a multi-line regex, skip it. */
 		if (ink->end == NULL)
 			continue;
 
-		for (line = openfile->filetop; line != NULL; line = line->next) {
+		line = first;
+
+		/* When a region runs into the given line, redo it from its start. */
+		while (line->prev != NULL && line->prev->multidata != NULL &&
+						(line->prev->multidata[ink->id] == CWOULDBE ||
+						line->prev->multidata[ink->id] == CENDAFTER ||
+						line->prev->multidata[ink->id] == CWHOLELINE))
+			line = line->prev;
+
+		for (; line != NULL; line = line->next) {
 			int index = 0;
 
 			/* Assume nothing applies until proven otherwise below. */
 			line->multidata[ink->id] = CNONE;
 
 			/* For an unpaired start match, mark all remaining lines. */
-			if (line->prev && line->prev->multidata[ink->id] == CWOULDBE) {
+			if (line->prev && line->prev->multidata &&
+						line->prev->multidata[ink->id] == CWOULDBE) {
 				line->multidata[ink->id] = CWOULDBE;
 				continue;
 			}
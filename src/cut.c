@@ -36,7 +36,8 @@ void do_deletion(undo_type action)
 	/* When in the middle of a line, delete the current character. */
 	if (openfile->current->data[openfile->current_x] != '\0') {
 		int charlen = char_length(openfile->current->data + openfile->current_x);
-		size_t line_len = strlen(openfile->current->data + openfile->current_x);
+		size_t line_len = line_length(openfile->current) - openfile->current_x;
+		size_t chars = line_chars(openfile->current);
 #ifndef NANO_TINY
 		/* If the type of action changed or the cursor moved to a different
 		 * line, create a new undo item, otherwise update the existing item. */
@@ -50,9 +51,12 @@ void do_deletion(undo_type action)
 			old_amount = number_of_chunks_in(openfile->current);
 #endif
 		/* Move the remainder of the line "in", over the current character. */
+		unshare_data(openfile->current);
 		memmove(&openfile->current->data[openfile->current_x],
 					&openfile->current->data[openfile->current_x + charlen],
 					line_len - charlen + 1);
+		set_counts(openfile->current, openfile->current_x + line_len - charlen,
+										chars - 1);
 #ifndef NANO_TINY
 		/* Adjust the mark if it is after the cursor on the current line. */
 		if (openfile->mark == openfile->current &&
@@ -62,6 +66,7 @@ void do_deletion(undo_type action)
 	/* Otherwise, when not at end of buffer, join this line with the next. */
 	} else if (openfile->current != openfile->filebot) {
 		linestruct *joining = openfile->current->next;
+		size_t length, chars;
 
 		/* If there is a magic line, and we're before it: don't eat it. */
 		if (joining == openfile->filebot && openfile->current_x != 0 &&
@@ -77,9 +82,13 @@ void do_deletion(undo_type action)
 		add_undo(action, NULL);
 #endif
 		/* Add the contents of the next line to those of the current one. */
-		openfile->current->data = charealloc(openfile->current->data,
-				strlen(openfile->current->data) + strlen(joining->data) + 1);
+		length = line_length(openfile->current);
+		chars = line_chars(openfile->current);
+
+		resize_data(openfile->current, length + line_length(joining) + 1);
 		strcat(openfile->current->data, joining->data);
+		set_counts(openfile->current, length + line_length(joining),
+										chars + line_chars(joining));
 
 #ifndef NANO_TINY
 		/* Adjust the mark if it was on the line that was "eaten". */
@@ -89,7 +98,7 @@ void do_deletion(undo_type action)
 		}
 #endif
 		unlink_node(joining);
-		renumber_from(openfile->current);
+		renumber_span(openfile->current, openfile->current);
 
 		/* Two lines were joined, so we need to refresh the screen. */
 		refresh_needed = TRUE;
@@ -266,23 +275,56 @@ void cut_to_eof(void)
 	extract(openfile->current, openfile->current_x,
 				openfile->filebot, strlen(openfile->filebot->data));
 }
+
+/* Put a copy of the text that do_snip() would otherwise cut into the
+ * cutbuffer, without changing the current buffer, and leave the cursor
+ * at the end of that text -- as if the text had been cut and pasted. */
+void copy_piece(bool *right_side_up)
+{
+	linestruct *top = openfile->current, *bot = openfile->current;
+	size_t top_x = openfile->current_x;
+	size_t bot_x = strlen(openfile->current->data);
+
+	if (openfile->mark) {
+		get_region((const linestruct **)&top, &top_x,
+					(const linestruct **)&bot, &bot_x, right_side_up);
+		openfile->mark = NULL;
+
+		openfile->current = top;
+		openfile->current_x = top_x;
+		openfile->placewewant = xplustabs();
+	} else if (ISSET(CUT_FROM_CURSOR)) {
+		/* At the end of a line, the line separation is copied. */
+		if (top_x == bot_x && bot != openfile->filebot) {
+			bot = bot->next;
+			bot_x = 0;
+			openfile->placewewant = xplustabs();
+		}
+	} else {
+		/* Copy the whole line, including its line separation. */
+		top_x = 0;
+		if (bot != openfile->filebot) {
+			bot = bot->next;
+			bot_x = 0;
+		}
+		openfile->placewewant = 0;
+	}
+
+	copy_region(top, top_x, bot, bot_x);
+
+	openfile->current = bot;
+	openfile->current_x = bot_x;
+}
 #endif /* !NANO_TINY */
 
-/* Move text from the current buffer into the cutbuffer.  If
- * copying is TRUE, copy the text back into the buffer afterward.
+/* Move text from the current buffer into the cutbuffer -- or, if copying
+ * is TRUE, put a copy of the text there, leaving the buffer unchanged.
  * If until_eof is TRUE, move all text from the current cursor
  * position to the end of the file into the cutbuffer.  If append
  * is TRUE (when zapping), always append the cut to the cutbuffer. */
 void do_snip(bool copying, bool marked, bool until_eof, bool append)
 {
 #ifndef NANO_TINY
-	linestruct *was_bottom = NULL;
-		/* The current end of the cutbuffer, before we add text to it. */
-	size_t botlen = 0;
-		/* The length of the string at the current end of the cutbuffer,
-		 * before we add text to it. */
-	bool using_magicline = !ISSET(NO_NEWLINES);
-		/* Whether an automatic newline should be added at end-of-buffer. */
 	bool right_side_up = TRUE;
 		/* There *is* no region, *or* it is marked forward. */
 #endif
@@ -302,13 +344,15 @@ void do_snip(bool copying, bool marked, bool until_eof, bool append)
 
 #ifndef NANO_TINY
 	if (copying) {
-		/* If the cutbuffer isn't empty, remember where it currently ends. */
-		if (cutbuffer != NULL) {
-			was_bottom = cutbottom;
-			botlen = strlen(cutbottom->data);
-		}
-		/* Don't add a magic line when moving text to the cutbuffer. */
-		SET(NO_NEWLINES);
+		copy_piece(&right_side_up);
+
+		/* If the copied region was marked forward, put the new desired
+		 * x position at its end; otherwise, leave it at its beginning. */
+		if (cutbuffer != NULL && right_side_up)
+			openfile->placewewant = xplustabs();
+
+		refresh_needed = TRUE;
+		return;
 	}
 
 	/* Now move the relevant piece of text into the cutbuffer. */
@@ -323,29 +367,7 @@ void do_snip(bool copying, bool marked, bool until_eof, bool append)
 #endif
 		cut_line();
 
-#ifndef NANO_TINY
-	if (copying) {
-		/* Copy the text that was put into the cutbuffer back into the current
-		 * file buffer, so that in the end nothing has been deleted. */
-		if (cutbuffer != NULL) {
-			if (was_bottom != NULL) {
-				was_bottom->data += botlen;
-				copy_from_buffer(was_bottom);
-				was_bottom->data -= botlen;
-			} else
-				copy_from_buffer(cutbuffer);
-
-			/* If the copied region was marked forward, put the new desired
-			 * x position at its end; otherwise, leave it at its beginning. */
-			if (right_side_up)
-				openfile->placewewant = xplustabs();
-		}
-		/* Restore the magic-line behavior now that we're done fiddling. */
-		if (using_magicline)
-			UNSET(NO_NEWLINES);
-	} else
-#endif
-		set_modified();
+	set_modified();
 
 	refresh_needed = TRUE;
 }
@@ -399,27 +421,22 @@ void cut_text(void)
 }
 
 #ifndef NANO_TINY
-/* Move text from the current buffer into the cutbuffer, and copy it
- * back into the buffer afterward.  If the mark is set or the cursor
- * was moved, blow away previous contents of the cutbuffer. */
+/* Copy text from the current buffer into the cutbuffer.  If the mark is
+ * set or the cursor was moved, blow away previous contents of the cutbuffer. */
 void copy_text(void)
 {
 	bool mark_is_set = (openfile->mark != NULL);
 
-	/* Remember the current viewport and cursor position. */
-	ssize_t is_edittop_lineno = openfile->edittop->lineno;
-	size_t is_firstcolumn = openfile->firstcolumn;
-	ssize_t is_current_lineno = openfile->current->lineno;
-	size_t is_current_x = openfile->current_x;
+	/* Remember the cursor position. */
+	linestruct *was_current = openfile->current;
+	size_t was_current_x = openfile->current_x;
 
 	do_snip(TRUE, mark_is_set, FALSE, FALSE);
 
-	/* If the mark was set, restore the viewport and cursor position. */
+	/* If the mark was set, restore the cursor position. */
 	if (mark_is_set) {
-		openfile->edittop = line_from_number(is_edittop_lineno);
-		openfile->firstcolumn = is_firstcolumn;
-		openfile->current = line_from_number(is_current_lineno);
-		openfile->current_x = is_current_x;
+		openfile->current = was_current;
+		openfile->current_x = was_current_x;
 	} else
 		focusing = FALSE;
 
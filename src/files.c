@@ -24,13 +24,35 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <poll.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 #ifdef HAVE_PWD_H
 #include <pwd.h>
 #endif
 #include <string.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 #define LOCKBUFSIZE 8192
+#define LUMPSIZE 1048576
+#define WINDOWTHRESHOLD (64 * LUMPSIZE)
+#define WINDOWLINES 8192
+#define MAXWINDOWLINES (64 * WINDOWLINES)
+#define WRITEBATCH 512
+#define JOURNALDELAY 2
+#define JOURNALMAGIC "nano journal 2\n"
+
+#ifndef HAVE_FDATASYNC
+#define fdatasync fsync
+#endif
 
 /* Verify that the containing directory of the given filename exists. */
 bool has_valid_path(const char *filename)
@@ -88,8 +110,7 @@ void make_new_buffer(void)
 
 	openfile->filename = copy_of("");
 
-	openfile->filetop = make_new_node(NULL);
-	openfile->filetop->data = copy_of("");
+	openfile->filetop = make_text_node(NULL, "");
 	openfile->filebot = openfile->filetop;
 
 	openfile->current = openfile->filetop;
@@ -117,6 +138,28 @@ void make_new_buffer(void)
 
 	openfile->current_stat = NULL;
 	openfile->lock_filename = NULL;
+
+	openfile->lineindex = NULL;
+	openfile->indexed = 0;
+	openfile->indexroom = 0;
+	openfile->stridechars = NULL;
+	openfile->charsums = NULL;
+	openfile->summed = 0;
+	openfile->stale = -1;
+	openfile->unnumbered = NULL;
+	openfile->lag = 0;
+	openfile->arena = NULL;
+	openfile->loader = NULL;
+	openfile->window = NULL;
+	openfile->follower = NULL;
+	openfile->journal = NULL;
+	openfile->packed = NULL;
+	openfile->visited = time(NULL);
+	openfile->gzipped = FALSE;
+
+	openfile->watch = -1;
+	openfile->disk_change = SAME_ON_DISK;
+	openfile->reported_change = SAME_ON_DISK;
 #endif
 #ifdef ENABLE_COLOR
 	openfile->syntax = NULL;
@@ -128,6 +171,12 @@ void make_new_buffer(void)
  * update the titlebar to display the file's new status. */
 void set_modified(void)
 {
+#ifndef NANO_TINY
+	/* Once edited, the lines may have parts on the heap. */
+	if (openfile->arena != NULL)
+		openfile->arena->pristine = FALSE;
+#endif
+
 	if (openfile->modified)
 		return;
 
@@ -135,6 +184,12 @@ void set_modified(void)
 	titlebar(NULL);
 
 #ifndef NANO_TINY
+	/* Once the buffer differs from the file, new text cannot be added. */
+	if (openfile->follower != NULL) {
+		stop_following(openfile);
+		statusline(MILD, _("Buffer was modified -- no longer following the file"));
+	}
+
 	if (!ISSET(LOCKING) || openfile->filename[0] == '\0')
 		return;
 
@@ -400,283 +455,3840 @@ void stat_with_alloc(const char *filename, struct stat **pstat)
 		*pstat = NULL;
 	}
 }
-#endif /* !NANO_TINY */
 
-/* This does one of three things.  If the filename is "", it just creates
- * a new empty buffer.  When the filename is not empty, it reads that file
- * into a new buffer when requested, otherwise into the existing buffer. */
-bool open_buffer(const char *filename, bool new_buffer)
+/* A journal holds the edits that were made to a buffer since its file was
+ * last read or saved, so that after a crash they can be replayed onto the
+ * unchanged file.  After a header that identifies the state of the file,
+ * it consists of records: a kind byte, the length of the data, and the data.
+ * The kinds of record are:
+ *   'D'  an undo item that was done, in the form needed for redoing it;
+ *   'P'  a still growing undo item, provisionally; any next record replaces it;
+ *   'U'  an undo of the current item;
+ *   'R'  a redo of the item above the current one;
+ *   'u'  an undo of an item from before the journal began. */
+
+/* Return the name of the journal for the given file: a hidden file next to
+ * it, named like the lock file but with a different suffix. */
+char *journal_name(const char *filename)
 {
-	char *realname;
-		/* The filename after tilde expansion. */
-	struct stat fileinfo;
-	FILE *f;
-	int rc;
-		/* rc == -2 means that we have a new file.  -1 means that the
-		 * open() failed.  0 means that the open() succeeded. */
+	char *namecopy = copy_of(filename);
+	char *secondcopy = copy_of(filename);
+	char *journalname = charalloc(strlen(filename) + strlen(locking_prefix) +
+										strlen(journal_suffix) + 3);
 
-	/* Display newlines in filenames as ^J. */
-	as_an_at = FALSE;
+	sprintf(journalname, "%s/%s%s%s", dirname(namecopy), locking_prefix,
+										basename(secondcopy), journal_suffix);
+	free(namecopy);
+	free(secondcopy);
 
-#ifdef ENABLE_OPERATINGDIR
-	if (outside_of_confinement(filename, FALSE)) {
-		statusline(ALERT, _("Can't read file from outside of %s"),
-								operating_dir);
-		return FALSE;
-	}
-#endif
+	return journalname;
+}
 
-	realname = real_dir_from_tilde(filename);
+/* Begin a new journal for the given buffer, discarding any earlier one.
+ * The journal file itself gets created only when there is something to
+ * put into it. */
+void start_journal(openfilestruct *buffer)
+{
+	journalstruct *journal;
+	undostruct *item;
 
-	/* Don't try to open directories, character files, or block files. */
-	if (*filename != '\0' && stat(realname, &fileinfo) == 0) {
-		if (S_ISDIR(fileinfo.st_mode)) {
-			statusline(ALERT, _("\"%s\" is a directory"), realname);
-			free(realname);
-			return FALSE;
-		}
-		if (S_ISCHR(fileinfo.st_mode) || S_ISBLK(fileinfo.st_mode)) {
-			statusline(ALERT, _("\"%s\" is a device file"), realname);
-			free(realname);
-			return FALSE;
-		}
-#ifdef NANO_TINY
-		if (S_ISFIFO(fileinfo.st_mode)) {
-			statusline(ALERT, _("\"%s\" is a FIFO"), realname);
-			free(realname);
-			return FALSE;
-		}
-#endif
-	}
+	if (buffer->journal != NULL)
+		drop_journal(buffer);
 
-	/* If we're going to load into a new buffer, first create the new
-	 * buffer and (if possible) lock the corresponding file. */
-	if (new_buffer) {
-		make_new_buffer();
+	/* Changes that do not go through the undo stack cannot be journaled. */
+	if (!ISSET(JOURNAL) || ISSET(RESTRICTED) || buffer->filename[0] == '\0' ||
+						buffer->follower != NULL)
+		return;
 
-		if (has_valid_path(realname)) {
-#ifndef NANO_TINY
-			if (ISSET(LOCKING) && filename[0] != '\0') {
-				/* When not overriding an existing lock, discard the buffer. */
-				if (do_lockfile(realname) < 0) {
-#ifdef ENABLE_MULTIBUFFER
-					if (openfile != openfile->next)
-						close_buffer();
-#endif
-					free(realname);
-					return FALSE;
-				}
-			}
-#endif /* !NANO_TINY */
-		}
-	}
+	journal = nmalloc(sizeof(journalstruct));
 
-	/* If the filename isn't blank, and we are not in NOREAD_MODE,
-	 * open the file.  Otherwise, treat it as a new file. */
-	rc = (filename[0] != '\0' && !ISSET(NOREAD_MODE)) ?
-						open_file(realname, new_buffer, &f) : -2;
+	journal->filename = journal_name(buffer->filename);
+	journal->fd = -1;
+	journal->exists = (buffer->current_stat != NULL);
+	if (journal->exists)
+		journal->base = *buffer->current_stat;
+	else
+		memset(&journal->base, 0, sizeof(struct stat));
+	journal->current = buffer->current_undo;
+	journal->amidst = FALSE;
+	journal->landing = NULL;
+	journal->pending = NULL;
+	journal->filled = 0;
+	journal->room = 0;
+	journal->sketched = NULL;
+	journal->sketchsize = 0;
+	journal->due = 0;
+
+	/* None of the existing undo items are in the new journal. */
+	for (item = buffer->undotop; item != NULL; item = item->next)
+		item->xflags &= ~WAS_JOURNALED;
+
+	buffer->journal = journal;
+}
 
-	/* If we have a non-new file, read it in.  Then, if the buffer has
-	 * no stat, update the stat, if applicable. */
-	if (rc > 0) {
-		install_handler_for_Ctrl_C();
+/* Stop keeping a journal for the given buffer.  When the journal file
+ * was created by us, delete it. */
+void drop_journal(openfilestruct *buffer)
+{
+	journalstruct *journal = buffer->journal;
 
-		read_file(f, rc, realname, !new_buffer);
+	if (journal->fd >= 0) {
+		close(journal->fd);
+		unlink(journal->filename);
+	}
 
-		restore_handler_for_Ctrl_C();
+	free(journal->filename);
+	free(journal->pending);
+	free(journal);
 
-#ifndef NANO_TINY
-		if (openfile->current_stat == NULL)
-			stat_with_alloc(realname, &openfile->current_stat);
-#endif
-	}
+	buffer->journal = NULL;
+}
 
-	/* If we have a file, and we've loaded it into a new buffer, set
-	 * the filename and put the cursor at the start of the buffer. */
-	if (rc != -1 && new_buffer) {
-		openfile->filename = mallocstrcpy(openfile->filename, realname);
-		openfile->current = openfile->filetop;
-		openfile->current_x = 0;
-		openfile->placewewant = 0;
+/* Append the given bytes to the pending records of the given journal. */
+void journal_bytes(journalstruct *journal, const void *bytes, size_t count)
+{
+	if (journal->filled + count > journal->room) {
+		journal->room = 2 * (journal->filled + count);
+		journal->pending = charealloc(journal->pending, journal->room);
 	}
 
-#ifdef ENABLE_COLOR
-	/* If we're loading into a new buffer, update the colors to account
-	 * for it, if applicable. */
-	if (new_buffer)
-		color_update();
-#endif
-	free(realname);
-	return TRUE;
+	memcpy(journal->pending + journal->filled, bytes, count);
+	journal->filled += count;
 }
 
-#ifdef ENABLE_SPELLER
-/* Open the specified file, and if that succeeds, remove the text of the marked
- * region or of the entire buffer and read the file contents into its place. */
-bool replace_buffer(const char *filename, undo_type action, bool marked,
-		const char *operation)
+/* Append the given number to the pending records of the given journal. */
+void journal_number(journalstruct *journal, long long number)
 {
-	linestruct *was_cutbuffer = cutbuffer;
-	int descriptor;
-	FILE *f;
+	journal_bytes(journal, &number, sizeof(number));
+}
 
-	descriptor = open_file(filename, FALSE, &f);
+/* Append the given text of the given length to the pending records of the
+ * given journal -- or a marker for its absence, when text is NULL. */
+void journal_text(journalstruct *journal, const char *text, size_t length)
+{
+	journal_number(journal, (text == NULL) ? -1 : (long long)length);
 
-	if (descriptor < 0)
-		return FALSE;
+	if (text != NULL)
+		journal_bytes(journal, text, length);
+}
 
-#ifndef NANO_TINY
-	add_undo(COUPLE_BEGIN, operation);
-#endif
+/* Append to the given journal the start of a record of the given kind. */
+void journal_mark(journalstruct *journal, char kind)
+{
+	journal_bytes(journal, &kind, 1);
+	journal_number(journal, 0);
 
-	/* When nothing is marked, start at the top of the buffer. */
-	if (!marked) {
-		openfile->current = openfile->filetop;
-		openfile->current_x = 0;
+	/* Any record supersedes a provisional one. */
+	journal->sketched = NULL;
+}
+
+/* Append a record of the given kind, describing the given undo item, to the
+ * given journal.  When as_redo is TRUE, the item has been carried out and is
+ * recorded in the form that is needed for redoing it: for a replacement and
+ * for an insertion, the new text is taken from the current buffer. */
+void journal_item(journalstruct *journal, char kind, undostruct *u, bool as_redo)
+{
+	size_t start = journal->filled;
+	const char *strdata = u->strdata;
+	groupstruct *group;
+	linestruct *line;
+	long long count = 0;
+
+	journal_mark(journal, kind);
+
+	journal_number(journal, u->type);
+	journal_number(journal, u->xflags & ~WAS_JOURNALED);
+	journal_number(journal, u->lineno);
+	journal_number(journal, u->begin);
+	journal_number(journal, u->wassize);
+	journal_number(journal, u->newsize);
+	journal_number(journal, u->mark_begin_lineno);
+	journal_number(journal, u->mark_begin_x);
+
+	/* A done replacement holds the old text; a redo needs the new one. */
+	if (as_redo && u->type == REPLACE)
+		strdata = line_from_number(u->mark_begin_lineno)->data;
+
+	journal_text(journal, strdata, (strdata == NULL) ? 0 : strlen(strdata));
+
+	for (group = u->grouping; group != NULL; group = group->next)
+		count++;
+
+	journal_number(journal, count);
+
+	for (group = u->grouping; group != NULL; group = group->next) {
+		journal_number(journal, group->top_line);
+		journal_number(journal, group->bottom_line);
+		for (ssize_t index = 0; index <= group->bottom_line - group->top_line; index++)
+			journal_text(journal, group->indentations[index],
+								strlen(group->indentations[index]));
 	}
 
-	/* Throw away the marked region or the whole buffer. */
-	cutbuffer = NULL;
-#ifndef NANO_TINY
-	add_undo(action, NULL);
-#endif
-	do_snip(FALSE, marked, !marked, FALSE);
-#ifndef NANO_TINY
-	update_undo(action);
-#endif
-	free_lines(cutbuffer);
-	cutbuffer = was_cutbuffer;
+	/* A done insertion holds no text; a redo needs the inserted text. */
+	if (as_redo && u->type == INSERT) {
+		journal_number(journal, u->mark_begin_lineno - u->lineno + 1);
 
-	/* Insert the spell-checked file into the cleared area. */
-	read_file(f, descriptor, filename, TRUE);
+		for (line = line_from_number(u->lineno); TRUE; line = line->next) {
+			size_t from = (line->lineno == u->lineno) ? u->begin : 0;
+			size_t upto = (line->lineno == u->mark_begin_lineno) ?
+								u->mark_begin_x : strlen(line->data);
 
-#ifndef NANO_TINY
-	add_undo(COUPLE_END, operation);
-#endif
-	return TRUE;
-}
-#endif /* ENABLE_SPELLER */
+			journal_text(journal, line->data + from, upto - from);
 
-/* Update the titlebar and the multiline cache to match the current buffer. */
-void prepare_for_display(void)
-{
-	/* Update the titlebar, since the filename may have changed. */
-	if (!inhelp)
-		titlebar(NULL);
+			if (line->lineno == u->mark_begin_lineno)
+				break;
+		}
+	} else {
+		count = 0;
+		for (line = u->cutbuffer; line != NULL; line = line->next)
+			count++;
 
-#ifdef ENABLE_COLOR
-	/* If there are multiline coloring regexes, and there is no
-	 * multiline cache data yet, precalculate it now. */
-	if (openfile->syntax && openfile->syntax->nmultis > 0 &&
-				openfile->filetop->multidata == NULL)
-		precalc_multicolorinfo();
+		journal_number(journal, count);
 
-	have_palette = FALSE;
-#endif
-	refresh_needed = TRUE;
-}
+		for (line = u->cutbuffer; line != NULL; line = line->next)
+			journal_text(journal, line->data, strlen(line->data));
+	}
 
-#ifdef ENABLE_MULTIBUFFER
-/* Show name of current buffer and its number of lines on the status bar. */
-void mention_name_and_linecount(void)
-{
-	size_t count = openfile->filebot->lineno -
-						(openfile->filebot->data[0] == '\0' ? 1 : 0);
-#ifndef NANO_TINY
-	if (openfile->fmt != NIX_FILE)
-		/* TRANSLATORS: first %s is file name, second %s is file format. */
-		statusline(HUSH, P_("%s -- %zu line (%s)", "%s -- %zu lines (%s)", count),
-						openfile->filename[0] == '\0' ?
-						_("New Buffer") : tail(openfile->filename), count,
-						openfile->fmt == DOS_FILE ? _("DOS") : _("Mac"));
-	else
-#endif
-		statusline(HUSH, P_("%s -- %zu line", "%s -- %zu lines", count),
-						openfile->filename[0] == '\0' ?
-						_("New Buffer") : tail(openfile->filename), count);
+	/* Fill in the length of the data of the record. */
+	count = journal->filled - start - 1 - sizeof(long long);
+	memcpy(journal->pending + start + 1, &count, sizeof(count));
+
+	if (kind != 'P')
+		u->xflags |= WAS_JOURNALED;
 }
 
-/* Update title bar and such after switching to another buffer.*/
-void redecorate_after_switch(void)
+/* Append to the journal of the current buffer the done undo items that it
+ * lacks.  When all is FALSE, leave out the newest item if it may still grow. */
+void journal_the_stack(bool all)
 {
-	/* If only one file buffer is open, there is nothing to update. */
-	if (openfile == openfile->next) {
-		statusbar(_("No more open file buffers"));
-		return;
+	journalstruct *journal = openfile->journal;
+	undostruct *newest = openfile->current_undo;
+	undostruct **lacking, *item;
+	size_t count = 0;
+
+	/* After an undo or redo, the journal ends where the undo stack is now. */
+	if (journal->amidst) {
+		journal->current = newest;
+		journal->amidst = FALSE;
 	}
 
-#ifndef NANO_TINY
-	/* When not in softwrap mode, make sure firstcolumn is zero.  It might
-	 * be nonzero if we had softwrap mode on while in this buffer, and then
-	 * turned softwrap mode off while in a different buffer. */
-	if (!ISSET(SOFTWRAP))
-		openfile->firstcolumn = 0;
-#endif
+	if (!all && newest != NULL && newest != journal->current && (newest->type == ADD ||
+						newest->type == BACK || newest->type == DEL ||
+						newest->type == CUT || newest->type == ZAP))
+		newest = newest->next;
+
+	for (item = newest; item != journal->current; item = item->next) {
+		if (item == NULL) {
+			statusline(ALERT, _("Journal %s lost track of the edits -- dropping it"),
+								journal->filename);
+			drop_journal(openfile);
+			return;
+		}
+		count++;
+	}
 
-	/* Update titlebar and multiline info to match the current buffer. */
-	prepare_for_display();
+	if (count == 0)
+		return;
 
-	/* Ensure that the main loop will redraw the help lines. */
-	currmenu = MMOST;
+	/* Record the items in the order in which they were done. */
+	lacking = nmalloc(count * sizeof(undostruct *));
 
-	/* Prevent a possible Shift selection from getting cancelled. */
-	shift_held = TRUE;
+	for (item = newest; item != journal->current; item = item->next)
+		lacking[--count] = item;
 
-	/* Indicate on the status bar where we switched to. */
-	mention_name_and_linecount();
-}
+	for (item = newest; item != journal->current; item = item->next)
+		journal_item(journal, 'D', lacking[count++], TRUE);
 
-/* Switch to the previous entry in the list of open files. */
-void switch_to_prev_buffer(void)
-{
-	openfile = openfile->prev;
-	redecorate_after_switch();
+	free(lacking);
+
+	journal->current = newest;
 }
 
-/* Switch to the next entry in the list of open files. */
-void switch_to_next_buffer(void)
+/* Return the lowest item of the group of undo items that ends with the given
+ * item, or the item itself when it does not end a group. */
+undostruct *bottom_of_group(undostruct *u)
 {
-	openfile = openfile->next;
-	redecorate_after_switch();
+#ifdef ENABLE_WRAPPING
+	if (u->type == SPLIT_END)
+		while (u->type != SPLIT_BEGIN)
+			u = u->next;
+#endif
+	if (u->type == COUPLE_END)
+		u = u->next->next->next;
+
+	return u;
 }
 
-/* Remove the current buffer from the circular list of buffers. */
-void close_buffer(void)
+/* Record in the journal of the current buffer that the current undo item is
+ * about to be undone -- or when redoing, that the item above it is about to
+ * be redone.  An item from before the start of the journal is recorded in
+ * full, together with the items that get undone or redone along with it. */
+void journal_the_undo(bool redoing)
 {
-	openfilestruct *orphan = openfile;
+	journalstruct *journal = openfile->journal;
+	undostruct *u = openfile->current_undo;
+	undostruct **above, *last;
+	size_t count = 0;
+	bool known;
+
+	/* The undos and redos that an undo or redo does by itself are implied. */
+	if (journal->amidst && openfile->current_undo != journal->landing)
+		return;
 
-	if (orphan == startfile)
-		startfile = startfile->next;
+	journal_the_stack(TRUE);
 
-	orphan->prev->next = orphan->next;
-	orphan->next->prev = orphan->prev;
+	if (openfile->journal == NULL)
+		return;
 
-	free(orphan->filename);
-	free_lines(orphan->filetop);
-#ifndef NANO_TINY
-	free(orphan->current_stat);
-	free(orphan->lock_filename);
-	/* Free the undo stack. */
-	discard_until(NULL, orphan, TRUE);
-#endif
+	if (!redoing) {
+		last = bottom_of_group(u);
 
-	openfile = orphan->prev;
-	free(orphan);
+		journal->landing = last->next;
 
-	/* When just one buffer remains open, show "Exit" in the help lines. */
-	if (openfile == openfile->next)
-		exitfunc->desc = exit_tag;
-}
+		if (u->xflags & WAS_JOURNALED)
+			journal_mark(journal, 'U');
+		else
+			while (TRUE) {
+				journal_item(journal, 'u', u, FALSE);
+				if (u == last)
+					break;
+				u = u->next;
+			}
+	} else {
+		for (last = openfile->undotop; last != openfile->current_undo; last = last->next)
+			count++;
+
+		above = nmalloc(count * sizeof(undostruct *));
+		count = 0;
+
+		for (last = openfile->undotop; last != openfile->current_undo; last = last->next)
+			above[count++] = last;
+
+		u = above[count - 1];
+		known = (u->xflags & WAS_JOURNALED);
+
+		if (known)
+			journal_mark(journal, 'R');
+
+		/* Go upward through the group that gets redone. */
+		do {
+			last = above[--count];
+			if (!known)
+				journal_item(journal, 'D', last, FALSE);
+#ifdef ENABLE_WRAPPING
+		} while ((u->type == SPLIT_BEGIN && last->type != SPLIT_END) ||
+						(u->type == COUPLE_BEGIN && last->type != COUPLE_END));
+#else
+		} while (u->type == COUPLE_BEGIN && last->type != COUPLE_END);
+#endif
+		journal->landing = last;
+
+		free(above);
+	}
+
+	journal->amidst = TRUE;
+}
+
+/* Write the pending records of the journal of the given buffer to disk,
+ * after adding a still growing undo item provisionally.  Create the journal
+ * file when needed.  Return FALSE when something goes wrong. */
+bool write_journal(openfilestruct *buffer)
+{
+	journalstruct *journal = buffer->journal;
+	undostruct *newest = buffer->current_undo;
+	struct iovec pieces[3];
+	long long head[6];
+	int count = 0;
+
+	if (newest != NULL && newest != journal->current && !journal->amidst &&
+						newest->next == journal->current &&
+						(newest != journal->sketched ||
+						newest->newsize != journal->sketchsize)) {
+		journal_item(journal, 'P', newest, FALSE);
+		journal->sketched = newest;
+		journal->sketchsize = newest->newsize;
+	}
+
+	journal->due = 0;
+
+	if (journal->filled == 0)
+		return TRUE;
+
+	if (journal->fd < 0) {
+		journal->fd = open(journal->filename, O_WRONLY | O_CREAT | O_EXCL,
+										S_IRUSR | S_IWUSR);
+		if (journal->fd < 0)
+			goto failure;
+
+		head[0] = journal->exists;
+		head[1] = journal->base.st_dev;
+		head[2] = journal->base.st_ino;
+		head[3] = journal->base.st_size;
+		head[4] = journal->base.st_mtim.tv_sec;
+		head[5] = journal->base.st_mtim.tv_nsec;
+
+		pieces[0].iov_base = JOURNALMAGIC;
+		pieces[0].iov_len = strlen(JOURNALMAGIC);
+		pieces[1].iov_base = head;
+		pieces[1].iov_len = sizeof(head);
+		count = 2;
+	}
+
+	pieces[count].iov_base = journal->pending;
+	pieces[count].iov_len = journal->filled;
+
+	if (!write_pieces(journal->fd, pieces, count + 1) || fdatasync(journal->fd) != 0)
+		goto failure;
+
+	journal->filled = 0;
+
+	return TRUE;
+
+  failure:
+	statusline(ALERT, _("Error writing journal %s: %s"),
+								journal->filename, strerror(errno));
+	drop_journal(buffer);
+
+	return FALSE;
+}
+
+/* Bring the journal of the current buffer up to date (except for an undo
+ * item that may still grow), and write out the journals that have been
+ * lagging behind for a while.  Return TRUE when some journal still lags. */
+bool tend_journals(void)
+{
+	openfilestruct *buffer = openfile;
+	time_t now = time(NULL);
+	bool lagging = FALSE;
+
+	if (openfile->journal != NULL)
+		journal_the_stack(FALSE);
+
+	do {
+		journalstruct *journal = buffer->journal;
+		undostruct *newest = buffer->current_undo;
+
+		/* Something unwritten should get written after a short while. */
+		if (journal != NULL && journal->due == 0 && (journal->filled > 0 ||
+						(newest != NULL && newest != journal->current &&
+						(newest != journal->sketched ||
+						newest->newsize != journal->sketchsize))))
+			journal->due = now + JOURNALDELAY;
+
+		if (journal != NULL && journal->due != 0 && journal->due <= now)
+			write_journal(buffer);
+
+		if (buffer->journal != NULL && buffer->journal->due != 0)
+			lagging = TRUE;
+#ifdef ENABLE_MULTIBUFFER
+		buffer = buffer->next;
+#endif
+	} while (buffer != openfile);
+
+	return lagging;
+}
+
+/* Complete the journal of the current buffer and write it to disk.
+ * Return TRUE when this succeeded. */
+bool finish_journal(void)
+{
+	journal_the_stack(TRUE);
+
+	return (openfile->journal != NULL && write_journal(openfile));
+}
+
+/* Read a number from the journal data at *at (that ends at end) into *number.
+ * Return FALSE when there is not enough data. */
+bool take_number(const char **at, const char *end, long long *number)
+{
+	if (end - *at < (ptrdiff_t)sizeof(long long))
+		return FALSE;
+
+	memcpy(number, *at, sizeof(long long));
+	*at += sizeof(long long);
+
+	return TRUE;
+}
+
+/* Read a piece of text from the journal data at *at (that ends at end) into
+ * a new string, or NULL for an absent text.  Return FALSE for bad data. */
+bool take_text(const char **at, const char *end, char **text)
+{
+	long long length;
+
+	*text = NULL;
+
+	if (!take_number(at, end, &length) || length < -1 || length > end - *at)
+		return FALSE;
+
+	if (length >= 0) {
+		*text = charalloc(length + 1);
+		memcpy(*text, *at, length);
+		(*text)[length] = '\0';
+		*at += length;
+	}
+
+	return TRUE;
+}
+
+/* Build an undo item from the given data of a journal record.
+ * Return NULL when the data is malformed. */
+undostruct *item_from_record(const char *at, const char *end)
+{
+	undostruct *u = nmalloc(sizeof(undostruct));
+	groupstruct **tail = &u->grouping;
+	long long field[8], count, top, bottom;
+	linestruct *line = NULL;
+	bool okay = TRUE;
+	char *data;
+
+	u->strdata = NULL;
+	u->grouping = NULL;
+	u->cutbuffer = NULL;
+	u->next = NULL;
+
+	for (int index = 0; index < 8 && okay; index++)
+		okay = take_number(&at, end, &field[index]);
+
+	okay = okay && take_text(&at, end, &u->strdata) && take_number(&at, end, &count);
+
+	while (okay && count-- > 0) {
+		groupstruct *group;
+
+		if (!take_number(&at, end, &top) || !take_number(&at, end, &bottom) ||
+								top < 1 || bottom < top || bottom - top >= end - at) {
+			okay = FALSE;
+			break;
+		}
+
+		group = nmalloc(sizeof(groupstruct));
+		group->top_line = top;
+		group->bottom_line = bottom;
+		group->indentations = nmalloc((bottom - top + 1) * sizeof(char *));
+		group->next = NULL;
+
+		*tail = group;
+		tail = &group->next;
+
+		for (long long index = 0; index <= bottom - top; index++)
+			group->indentations[index] = NULL;
+
+		for (long long index = 0; index <= bottom - top && okay; index++)
+			okay = take_text(&at, end, &group->indentations[index]) &&
+								group->indentations[index] != NULL;
+	}
+
+	okay = okay && take_number(&at, end, &count) && count >= 0 && count <= end - at;
+
+	while (okay && count-- > 0) {
+		okay = take_text(&at, end, &data) && data != NULL;
+
+		if (okay) {
+			linestruct *newline = make_new_node(line);
+
+			newline->data = data;
+			if (line == NULL)
+				u->cutbuffer = newline;
+			else
+				line->next = newline;
+			line = newline;
+		}
+	}
+
+	if (!okay || at != end || field[0] < ADD || field[0] >= OTHER ||
+						field[2] < 1 || field[6] < 0) {
+		free_undo_item(u);
+		return NULL;
+	}
+
+	u->type = field[0];
+	u->xflags = field[1];
+	u->lineno = field[2];
+	u->begin = field[3];
+	u->wassize = field[4];
+	u->newsize = field[5];
+	u->mark_begin_lineno = field[6];
+	u->mark_begin_x = field[7];
+
+	return u;
+}
+
+/* Return TRUE when the given undo item is the start of a group of items. */
+bool opens_group(undostruct *u)
+{
+#ifdef ENABLE_WRAPPING
+	if (u->type == SPLIT_BEGIN)
+		return TRUE;
+#endif
+	return (u->type == COUPLE_BEGIN);
+}
+
+/* Return TRUE when the given undo item is the start or end of a group. */
+bool bounds_group(undostruct *u)
+{
+#ifdef ENABLE_WRAPPING
+	if (u->type == SPLIT_END)
+		return TRUE;
+#endif
+	return (u->type == COUPLE_END || opens_group(u));
+}
+
+/* When the current buffer is windowed, bring into memory the lines that the
+ * given undo item touches.  Return FALSE when that is not possible. */
+bool bring_in_item(undostruct *u)
+{
+	ssize_t top = u->lineno, bottom = u->lineno;
+	groupstruct *group;
+
+	if (openfile->window == NULL)
+		return TRUE;
+
+	/* For these two, the second line number is not a line number. */
+	if (u->type != COUPLE_BEGIN && u->type != COUPLE_END) {
+		if (u->mark_begin_lineno < top)
+			top = u->mark_begin_lineno;
+		if (u->mark_begin_lineno > bottom)
+			bottom = u->mark_begin_lineno;
+	}
+
+	for (group = u->grouping; group != NULL; group = group->next) {
+		if (group->top_line < top)
+			top = group->top_line;
+		if (group->bottom_line > bottom)
+			bottom = group->bottom_line;
+	}
+
+	/* A join involves also the line after the given ones. */
+	if (u->type == JOIN)
+		bottom++;
+
+	return (bring_in_line(top) && bring_in_line(bottom));
+}
+
+/* When the current buffer is windowed, bring into memory the lines that an
+ * undo (or redo) of the current (or next) item will touch.  Return FALSE
+ * when that is not possible. */
+bool bring_in_undo(bool redoing)
+{
+	undostruct *u = openfile->current_undo, *last;
+
+	if (openfile->window == NULL)
+		return TRUE;
+
+	if (redoing) {
+		for (last = openfile->undotop; last->next != u; last = last->next)
+			;
+		/* A group gets redone as a whole, so bring in everything above. */
+		u = opens_group(last) ? openfile->undotop : last;
+		last = openfile->current_undo;
+	} else
+		last = bottom_of_group(u)->next;
+
+	for (; u != last; u = u->next)
+		if (!bring_in_item(u))
+			return FALSE;
+
+	return TRUE;
+}
+
+/* Put the given undo item from a journal on top of the undo stack of the
+ * current buffer (dropping any undone items), and carry it out.  When the
+ * given base item gets dropped, forget it, and record that the buffer no
+ * longer has a point where it matches the file on disk.  Return FALSE (and
+ * discard the item) when the item cannot be carried out. */
+bool replay_item(undostruct *item, undostruct **base)
+{
+	bool keep = TRUE;
+	undostruct *dropit;
+
+	if (!bring_in_item(item)) {
+		free_undo_item(item);
+		return FALSE;
+	}
+
+	for (dropit = openfile->undotop; dropit != openfile->current_undo;
+												dropit = dropit->next)
+		if (dropit == *base) {
+			*base = NULL;
+			keep = FALSE;
+		}
+
+	discard_until(openfile->current_undo, openfile, keep);
+
+	item->next = openfile->undotop;
+	openfile->undotop = item;
+
+	/* The start of a group does nothing by itself. */
+	if (opens_group(item))
+		openfile->current_undo = item;
+	else
+		do_redo();
+
+	return TRUE;
+}
+
+/* Replay the records in the given journal data onto the current buffer, which
+ * must hold the file as it was when the journal began.  Return the number of
+ * bytes that were taken in: up to the first incomplete or malformed record,
+ * and without a trailing provisional record or an unfinished group. */
+size_t replay_journal(const char *data, size_t size)
+{
+	const char *at = data, *end = data + size;
+	undostruct *sketch = NULL, *base = NULL, *item = NULL, *last;
+	size_t used = 0, opened = 0;
+	long long length;
+	char kind;
+
+	/* Let no undo or redo declare the buffer unmodified in the meantime,
+	 * so that the edited lines of a windowed buffer stay in memory. */
+	replaying_journal = TRUE;
+	openfile->last_saved = NULL;
+	openfile->modified = TRUE;
+
+	while (end - at > (ptrdiff_t)sizeof(long long)) {
+		kind = *at;
+		memcpy(&length, at + 1, sizeof(long long));
+
+		if (length < 0 || length > end - at - 1 - (ptrdiff_t)sizeof(long long))
+			break;
+
+		if (kind == 'D' || kind == 'P' || kind == 'u') {
+			item = item_from_record(at + 1 + sizeof(long long),
+										at + 1 + sizeof(long long) + length);
+			if (item == NULL)
+				break;
+			/* An item from before the journal can go only at the bottom,
+			 * and only while the point of the file on disk is known. */
+			if (kind == 'u' && (openfile->current_undo != NULL ||
+								openfile->last_saved != NULL)) {
+				free_undo_item(item);
+				break;
+			}
+		} else if (kind == 'U' && length == 0) {
+			if (openfile->current_undo == NULL || !bring_in_undo(FALSE))
+				break;
+		} else if (kind == 'R' && length == 0) {
+			if (openfile->current_undo == openfile->undotop || !bring_in_undo(TRUE))
+				break;
+		} else
+			break;
+
+		if (kind == 'D' && opens_group(item))
+			opened = used;
+
+		if (sketch != NULL) {
+			free_undo_item(sketch);
+			sketch = NULL;
+		}
+
+		if (kind == 'P') {
+			sketch = item;
+			at += 1 + sizeof(long long) + length;
+			continue;
+		}
+
+		if (kind == 'D' && !replay_item(item, &base))
+			break;
+
+		if (kind == 'u' && !bring_in_item(item)) {
+			free_undo_item(item);
+			break;
+		}
+
+		at += 1 + sizeof(long long) + length;
+		used = at - data;
+
+		if (kind == 'D')
+			item->xflags |= WAS_JOURNALED;
+		else if (kind == 'U')
+			do_undo();
+		else if (kind == 'R')
+			do_redo();
+		else {
+			/* The file on disk is the result of the item being done. */
+			if (openfile->undotop == NULL)
+				openfile->undotop = item;
+			else {
+				for (last = openfile->undotop; last->next != NULL; last = last->next)
+					;
+				last->next = item;
+			}
+
+			if (base == NULL)
+				base = item;
+
+			item->xflags |= WAS_JOURNALED;
+
+			if (!bounds_group(item)) {
+				openfile->current_undo = item;
+				do_undo();
+			}
+		}
+	}
+
+	if (sketch != NULL)
+		replay_item(sketch, &base);
+
+	/* When the journal ends in the middle of a group of changes (because
+	 * nano died halfway an operation), undo the part that got done. */
+	for (item = openfile->current_undo; item != NULL; item = item->next) {
+		if (opens_group(item)) {
+			while (openfile->current_undo != item->next && bring_in_undo(FALSE))
+				do_undo();
+			if (openfile->current_undo == item->next) {
+				discard_until(item->next, openfile, TRUE);
+				used = opened;
+			}
+			break;
+		} else if (bounds_group(item))
+			break;
+	}
+
+	replaying_journal = FALSE;
+
+	/* Unless it was dropped, the file on disk is where the base item is. */
+	if (openfile->last_saved == NULL)
+		openfile->last_saved = base;
+	openfile->last_action = OTHER;
+	openfile->modified = FALSE;
+
+	if (openfile->current_undo != openfile->last_saved)
+		set_modified();
+
+	/* The size of a windowed buffer is that of the part in memory. */
+	if (openfile->window != NULL)
+		openfile->totsize = get_totsize(openfile->filetop, openfile->filebot);
+
+	return used;
+}
+
+/* If a journal exists for the file in the current buffer (left behind by
+ * a nano that died), offer to replay its edits.  Then start a new journal,
+ * or continue the replayed one. */
+void recover_journal(void)
+{
+	char *journalname = journal_name(openfile->filename);
+	size_t headsize = strlen(JOURNALMAGIC) + 6 * sizeof(long long);
+	struct stat *base = openfile->current_stat;
+	journalstruct *journal;
+	struct stat fileinfo;
+	size_t size, got = 0;
+	long long head[6];
+	char *data = NULL, *question;
+	ssize_t piece;
+	int fd, choice;
+
+	fd = open(journalname, O_RDWR);
+
+	if (fd < 0) {
+		free(journalname);
+		start_journal(openfile);
+		return;
+	}
+
+	size = (fstat(fd, &fileinfo) == 0) ? fileinfo.st_size : 0;
+	data = charalloc(size + 1);
+
+	while (got < size && (piece = read(fd, data + got, size - got)) != 0) {
+		if (piece < 0 && errno != EINTR)
+			break;
+		else if (piece > 0)
+			got += piece;
+	}
+
+	if (got >= headsize)
+		memcpy(head, data + strlen(JOURNALMAGIC), sizeof(head));
+
+	/* A journal is of use only when the file is as it was when the journal
+	 * began; otherwise leave the journal alone, and do not keep a new one. */
+	if (got < headsize || strncmp(data, JOURNALMAGIC, strlen(JOURNALMAGIC)) != 0 ||
+				head[0] != (base != NULL) || (base != NULL &&
+				(head[1] != (long long)base->st_dev || head[2] != (long long)base->st_ino ||
+				head[3] != (long long)base->st_size ||
+				head[4] != (long long)base->st_mtim.tv_sec ||
+				head[5] != (long long)base->st_mtim.tv_nsec))) {
+		statusline(ALERT, _("Journal %s does not fit the file -- ignoring it"),
+										journalname);
+		goto free_the_data;
+	}
+
+	if (!await_loading(0))
+		goto free_the_data;
+
+	question = charalloc(strlen(tail(openfile->filename)) + 60);
+	sprintf(question, _("Recover the unsaved edits of %s? "), tail(openfile->filename));
+	choice = do_yesno_prompt(FALSE, question);
+	free(question);
+
+	if (choice < 0) {
+		statusbar(_("Cancelled"));
+		goto free_the_data;
+	}
+
+	start_journal(openfile);
+
+	if (choice == 0 || openfile->journal == NULL) {
+		unlink(journalname);
+		goto free_the_data;
+	}
+
+	/* Keep the journal aside while its edits are being replayed. */
+	journal = openfile->journal;
+	openfile->journal = NULL;
+
+	got = replay_journal(data + headsize, got - headsize);
+
+	openfile->journal = journal;
+
+	/* Continue the journal, without what was not taken in. */
+	if (ftruncate(fd, headsize + got) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+		statusline(ALERT, _("Error writing journal %s: %s"),
+										journalname, strerror(errno));
+		drop_journal(openfile);
+		goto free_the_data;
+	}
+
+	journal->fd = fd;
+	fd = -1;
+
+	/* A provisional item is not yet in the journal. */
+	journal->current = openfile->current_undo;
+	if (journal->current != NULL && !(journal->current->xflags & WAS_JOURNALED))
+		journal->current = journal->current->next;
+
+	statusline(HUSH, _("Recovered the unsaved edits"));
+
+  free_the_data:
+	if (fd >= 0)
+		close(fd);
+	free(journalname);
+	free(data);
+}
+#endif /* !NANO_TINY */
+
+/* This does one of three things.  If the filename is "", it just creates
+ * a new empty buffer.  When the filename is not empty, it reads that file
+ * into a new buffer when requested, otherwise into the existing buffer. */
+bool open_buffer(const char *filename, bool new_buffer)
+{
+	char *realname;
+		/* The filename after tilde expansion. */
+	struct stat fileinfo;
+	FILE *f;
+	int rc;
+		/* rc == -2 means that we have a new file.  -1 means that the
+		 * open() failed.  0 means that the open() succeeded. */
+
+	/* Display newlines in filenames as ^J. */
+	as_an_at = FALSE;
+
+#ifdef ENABLE_OPERATINGDIR
+	if (outside_of_confinement(filename, FALSE)) {
+		statusline(ALERT, _("Can't read file from outside of %s"),
+								operating_dir);
+		return FALSE;
+	}
+#endif
+
+	realname = real_dir_from_tilde(filename);
+
+	/* Don't try to open directories, character files, or block files. */
+	if (*filename != '\0' && stat(realname, &fileinfo) == 0) {
+		if (S_ISDIR(fileinfo.st_mode)) {
+			statusline(ALERT, _("\"%s\" is a directory"), realname);
+			free(realname);
+			return FALSE;
+		}
+		if (S_ISCHR(fileinfo.st_mode) || S_ISBLK(fileinfo.st_mode)) {
+			statusline(ALERT, _("\"%s\" is a device file"), realname);
+			free(realname);
+			return FALSE;
+		}
+#ifdef NANO_TINY
+		if (S_ISFIFO(fileinfo.st_mode)) {
+			statusline(ALERT, _("\"%s\" is a FIFO"), realname);
+			free(realname);
+			return FALSE;
+		}
+#endif
+	}
+
+	/* If we're going to load into a new buffer, first create the new
+	 * buffer and (if possible) lock the corresponding file. */
+	if (new_buffer) {
+		make_new_buffer();
+
+		if (has_valid_path(realname)) {
+#ifndef NANO_TINY
+			if (ISSET(LOCKING) && filename[0] != '\0') {
+				/* When not overriding an existing lock, discard the buffer. */
+				if (do_lockfile(realname) < 0) {
+#ifdef ENABLE_MULTIBUFFER
+					if (openfile != openfile->next)
+						close_buffer();
+#endif
+					free(realname);
+					return FALSE;
+				}
+			}
+#endif /* !NANO_TINY */
+		}
+	}
+
+	/* If the filename isn't blank, and we are not in NOREAD_MODE,
+	 * open the file.  Otherwise, treat it as a new file. */
+	rc = (filename[0] != '\0' && !ISSET(NOREAD_MODE)) ?
+						open_file(realname, new_buffer, &f) : -2;
+
+	/* If we have a non-new file, read it in.  Then, if the buffer has
+	 * no stat, update the stat, if applicable. */
+	if (rc > 0) {
+		install_handler_for_Ctrl_C();
+
+		read_file(f, rc, realname, !new_buffer);
+
+		restore_handler_for_Ctrl_C();
+
+#ifndef NANO_TINY
+		if (openfile->current_stat == NULL)
+			stat_with_alloc(realname, &openfile->current_stat);
+#endif
+	}
+
+	/* If we have a file, and we've loaded it into a new buffer, set
+	 * the filename and put the cursor at the start of the buffer. */
+	if (rc != -1 && new_buffer) {
+		openfile->filename = mallocstrcpy(openfile->filename, realname);
+		openfile->current = openfile->filetop;
+		openfile->current_x = 0;
+		openfile->placewewant = 0;
+	}
+
+#ifdef ENABLE_COLOR
+	/* If we're loading into a new buffer, update the colors to account
+	 * for it, if applicable. */
+	if (new_buffer)
+		color_update();
+#endif
+#ifndef NANO_TINY
+	/* Keep an eye on the file, to notice when something else changes it. */
+	if (new_buffer && rc > 0)
+		watch_file(openfile);
+
+	/* Offer to recover edits that got lost when nano died, and then keep
+	 * track of the edits to this file. */
+	if (new_buffer && rc != -1 && ISSET(JOURNAL) && !ISSET(VIEW_MODE) &&
+						filename[0] != '\0')
+		recover_journal();
+#endif
+	free(realname);
+	return TRUE;
+}
+
+#ifdef ENABLE_SPELLER
+/* Open the specified file, and if that succeeds, remove the text of the marked
+ * region or of the entire buffer and read the file contents into its place. */
+bool replace_buffer(const char *filename, undo_type action, bool marked,
+		const char *operation)
+{
+	linestruct *was_cutbuffer = cutbuffer;
+	int descriptor;
+	FILE *f;
+
+	descriptor = open_file(filename, FALSE, &f);
+
+	if (descriptor < 0)
+		return FALSE;
+
+#ifndef NANO_TINY
+	add_undo(COUPLE_BEGIN, operation);
+#endif
+
+	/* When nothing is marked, start at the top of the buffer. */
+	if (!marked) {
+		openfile->current = openfile->filetop;
+		openfile->current_x = 0;
+	}
+
+	/* Throw away the marked region or the whole buffer. */
+	cutbuffer = NULL;
+#ifndef NANO_TINY
+	add_undo(action, NULL);
+#endif
+	do_snip(FALSE, marked, !marked, FALSE);
+#ifndef NANO_TINY
+	update_undo(action);
+#endif
+	free_lines(cutbuffer);
+	cutbuffer = was_cutbuffer;
+
+	/* Insert the spell-checked file into the cleared area. */
+	read_file(f, descriptor, filename, TRUE);
+
+#ifndef NANO_TINY
+	add_undo(COUPLE_END, operation);
+#endif
+	return TRUE;
+}
+#endif /* ENABLE_SPELLER */
+
+/* Update the titlebar and the multiline cache to match the current buffer. */
+void prepare_for_display(void)
+{
+	/* Update the titlebar, since the filename may have changed. */
+	if (!inhelp)
+		titlebar(NULL);
+
+#ifdef ENABLE_COLOR
+	/* If there are multiline coloring regexes, and there is no
+	 * multiline cache data yet, precalculate it now. */
+	if (openfile->syntax && openfile->syntax->nmultis > 0 &&
+				openfile->filetop->multidata == NULL)
+		precalc_multicolorinfo();
+#ifndef NANO_TINY
+	/* If a followed file grew while elsewhere, color the new lines. */
+	else if (openfile->follower != NULL && openfile->follower->uncolored != NULL)
+		precalc_multicolorinfo_from(openfile->follower->uncolored);
+
+	if (openfile->follower != NULL)
+		openfile->follower->uncolored = NULL;
+#endif
+
+	have_palette = FALSE;
+#endif
+	refresh_needed = TRUE;
+}
+
+#ifdef ENABLE_MULTIBUFFER
+/* Show name of current buffer and its number of lines on the status bar. */
+void mention_name_and_linecount(void)
+{
+	size_t count = openfile->filebot->lineno -
+						(openfile->filebot->data[0] == '\0' ? 1 : 0);
+#ifndef NANO_TINY
+	windowstruct *window = openfile->window;
+
+	/* For a huge file, count the lines of the file, not of the window. */
+	if (window != NULL && window->endbyte < window->size && window->lastline > 0)
+		count = windowed_textlines(window);
+
+	if (openfile->loader != NULL || (window != NULL &&
+						window->endbyte < window->size && window->lastline == 0))
+		statusline(HUSH, P_("%s -- %zu line so far", "%s -- %zu lines so far", count),
+						tail(openfile->filename), count);
+	else if (openfile->fmt != NIX_FILE)
+		/* TRANSLATORS: first %s is file name, second %s is file format. */
+		statusline(HUSH, P_("%s -- %zu line (%s)", "%s -- %zu lines (%s)", count),
+						openfile->filename[0] == '\0' ?
+						_("New Buffer") : tail(openfile->filename), count,
+						openfile->fmt == DOS_FILE ? _("DOS") : _("Mac"));
+	else
+#endif
+		statusline(HUSH, P_("%s -- %zu line", "%s -- %zu lines", count),
+						openfile->filename[0] == '\0' ?
+						_("New Buffer") : tail(openfile->filename), count);
+}
+
+/* Update title bar and such after switching to another buffer.*/
+void redecorate_after_switch(void)
+{
+#ifndef NANO_TINY
+	/* A buffer that was packed while it was idle needs its lines back. */
+	if (openfile->packed != NULL)
+		unpack_buffer();
+#endif
+
+	/* If only one file buffer is open, there is nothing to update. */
+	if (openfile == openfile->next) {
+		statusbar(_("No more open file buffers"));
+		return;
+	}
+
+#ifndef NANO_TINY
+	/* When not in softwrap mode, make sure firstcolumn is zero.  It might
+	 * be nonzero if we had softwrap mode on while in this buffer, and then
+	 * turned softwrap mode off while in a different buffer. */
+	if (!ISSET(SOFTWRAP))
+		openfile->firstcolumn = 0;
+#endif
+
+	/* Update titlebar and multiline info to match the current buffer. */
+	prepare_for_display();
+
+	/* Ensure that the main loop will redraw the help lines. */
+	currmenu = MMOST;
+
+	/* Prevent a possible Shift selection from getting cancelled. */
+	shift_held = TRUE;
+
+	/* Indicate on the status bar where we switched to. */
+	mention_name_and_linecount();
+}
+
+/* Switch to the previous entry in the list of open files. */
+void switch_to_prev_buffer(void)
+{
+	openfile = openfile->prev;
+	redecorate_after_switch();
+}
+
+/* Switch to the next entry in the list of open files. */
+void switch_to_next_buffer(void)
+{
+	openfile = openfile->next;
+	redecorate_after_switch();
+}
+
+/* Remove the current buffer from the circular list of buffers. */
+void close_buffer(void)
+{
+	openfilestruct *orphan = openfile;
+
+#ifndef NANO_TINY
+	/* Drop the watch while the buffer is still among the others. */
+	unwatch_file(orphan);
+#endif
+
+	if (orphan == startfile)
+		startfile = startfile->next;
+
+	orphan->prev->next = orphan->next;
+	orphan->next->prev = orphan->prev;
+
+#ifndef NANO_TINY
+	if (orphan->loader != NULL)
+		stop_loading(orphan);
+	if (orphan->window != NULL)
+		close_window(orphan->window);
+	if (orphan->follower != NULL)
+		stop_following(orphan);
+	if (orphan->journal != NULL)
+		drop_journal(orphan);
+#endif
+
+	free(orphan->filename);
+#ifndef NANO_TINY
+	free(orphan->current_stat);
+	free(orphan->lock_filename);
+	/* Free the undo stack -- before the arena that it may refer into. */
+	discard_until(NULL, orphan, TRUE);
+
+	free(orphan->lineindex);
+	free(orphan->stridechars);
+	free(orphan->charsums);
+	orphan->indexed = 0;
+	orphan->summed = 0;
+
+	if (orphan->arena != NULL)
+		free_arena_lines(orphan);
+	else
+#endif
+		free_lines(orphan->filetop);
+
+	openfile = orphan->prev;
+	free(orphan);
+
+	/* When just one buffer remains open, show "Exit" in the help lines. */
+	if (openfile == openfile->next)
+		exitfunc->desc = exit_tag;
+}
+
+#ifndef NANO_TINY
+/* Compress the given stretch of text, and add the result to the given pack. */
+void add_packblock(packstruct *pack, const char *text, size_t size, char *room)
+{
+	size_t packedsize = pack_text(text, size, room);
+	packblockstruct *block = nmalloc(sizeof(packblockstruct) + packedsize);
+
+	memcpy(block + 1, room, packedsize);
+	block->next = NULL;
+	block->size = packedsize;
+	block->rawsize = size;
+
+	if (pack->last == NULL)
+		pack->first = block;
+	else
+		pack->last->next = block;
+
+	pack->last = block;
+}
+
+/* Pack the texts of all lines of the given (idle) buffer into compressed
+ * blocks, and free the lines, plus everything that refers to them. */
+void pack_buffer(openfilestruct *buffer)
+{
+	packstruct *pack = nmalloc(sizeof(packstruct));
+	char *text = charalloc(PACKBLOCK);
+	char *room = charalloc(PACKBLOCK + PACKBLOCK / 255 + 16);
+	size_t filled = 0;
+
+	pack->first = NULL;
+	pack->last = NULL;
+	pack->lines = 0;
+	pack->current = 1;
+	pack->edittop = 1;
+	pack->mark = 0;
+
+	/* Put the texts one after the other, each with its terminating NUL,
+	 * and compress them per block, as a line may span several blocks. */
+	for (linestruct *line = buffer->filetop; line != NULL; line = line->next) {
+		const char *data = line->data;
+		size_t length = line_length(line) + 1;
+
+		pack->lines++;
+
+		if (line == buffer->current)
+			pack->current = pack->lines;
+		if (line == buffer->edittop)
+			pack->edittop = pack->lines;
+		if (line == buffer->mark)
+			pack->mark = pack->lines;
+
+		while (length > 0) {
+			size_t piece = (length < PACKBLOCK - filled) ? length : PACKBLOCK - filled;
+
+			memcpy(text + filled, data, piece);
+			filled += piece;
+			data += piece;
+			length -= piece;
+
+			if (filled == PACKBLOCK) {
+				add_packblock(pack, text, filled, room);
+				filled = 0;
+			}
+		}
+	}
+
+	if (filled > 0)
+		add_packblock(pack, text, filled, room);
+
+	free(text);
+	free(room);
+
+	/* What the undo items hold of the lines must survive their arena. */
+	if (buffer->arena != NULL)
+		for (undostruct *item = buffer->undotop; item != NULL; item = item->next) {
+			if (arena_of(item->strdata) == buffer->arena)
+				item->strdata = copy_of(item->strdata);
+			item->cutbuffer = lift_from_arena(item->cutbuffer, buffer->arena);
+		}
+
+	free(buffer->lineindex);
+	free(buffer->stridechars);
+	free(buffer->charsums);
+	buffer->lineindex = NULL;
+	buffer->stridechars = NULL;
+	buffer->charsums = NULL;
+	buffer->indexed = 0;
+	buffer->indexroom = 0;
+	buffer->summed = 0;
+	buffer->stale = -1;
+	buffer->unnumbered = NULL;
+	buffer->lag = 0;
+
+	if (buffer->arena != NULL)
+		free_arena_lines(buffer);
+	else
+		free_lines(buffer->filetop);
+
+	buffer->arena = NULL;
+	buffer->filetop = NULL;
+	buffer->filebot = NULL;
+	buffer->edittop = NULL;
+	buffer->current = NULL;
+	buffer->mark = NULL;
+#ifdef ENABLE_WRAPPING
+	buffer->spillage_line = NULL;
+#endif
+
+	buffer->packed = pack;
+}
+
+/* Unpack the texts of the lines of the current buffer, which was idle,
+ * into lines again, carved from a fresh arena, and put back the cursor,
+ * the top of the edit window, and the mark where they were. */
+void unpack_buffer(void)
+{
+	packstruct *pack = openfile->packed;
+	size_t bufsize = PACKBLOCK;
+	char *buffer = charalloc(bufsize);
+	size_t kept = 0;
+		/* The number of bytes of an incomplete line at the start of buffer. */
+	splitstruct split;
+
+	split.arena = make_arena();
+	split.format = 0;
+	split.in_place = FALSE;
+	split.topline = make_split_node(&split, NULL);
+	split.bottomline = split.topline;
+	split.num_lines = 0;
+
+	while (pack->first != NULL) {
+		packblockstruct *block = pack->first;
+		const char *head = buffer, *tail, *nul;
+
+		/* When a line does not fit, make room for it. */
+		while (kept + block->rawsize > bufsize) {
+			bufsize *= 2;
+			buffer = charealloc(buffer, bufsize);
+			head = buffer;
+		}
+
+		unpack_text((const char *)(block + 1), block->size, buffer + kept);
+		tail = buffer + kept + block->rawsize;
+
+		while ((nul = memchr(head, '\0', tail - head)) != NULL) {
+			/* The last line gets no empty line hung below it. */
+			if (split.num_lines + 1 < pack->lines)
+				store_line(&split, head, nul - head);
+			else
+				split.bottomline->data = encode_data(&split, head, nul - head);
+			head = nul + 1;
+		}
+
+		kept = tail - head;
+		memmove(buffer, head, kept);
+
+		pack->first = block->next;
+		free(block);
+	}
+
+	free(buffer);
+
+	adopt_blocks(split.arena, &split.arena->fresh);
+
+	openfile->arena = split.arena;
+	openfile->filetop = split.topline;
+	openfile->filebot = split.bottomline;
+	openfile->current = openfile->filetop;
+
+	openfile->current = line_from_number(pack->current);
+	openfile->edittop = line_from_number(pack->edittop);
+	if (pack->mark > 0)
+		openfile->mark = line_from_number(pack->mark);
+
+	openfile->packed = NULL;
+	free(pack);
+}
+
+/* Pack the buffers that were not visited for a while.  Return TRUE when
+ * some other buffer may get packed later, so a check is due in a while. */
+bool pack_idle_buffers(void)
+{
+	openfilestruct *buffer = openfile->next;
+	time_t now = time(NULL);
+	bool pending = FALSE;
+
+	openfile->visited = now;
+
+	for (; buffer != openfile; buffer = buffer->next) {
+		/* A buffer whose lines are still arriving is left alone. */
+		if (buffer->packed != NULL || buffer->loader != NULL ||
+					buffer->window != NULL || buffer->follower != NULL)
+			continue;
+
+		/* Records that wait to be written to a journal delay the packing. */
+		if (now - buffer->visited < compress_after ||
+					(buffer->journal != NULL && buffer->journal->due != 0))
+			pending = TRUE;
+		else
+			pack_buffer(buffer);
+	}
+
+	return pending;
+}
+#endif
 #endif /* ENABLE_MULTIBUFFER */
 
-/* Encode any NUL bytes in the given line of text, which is of length buf_len,
- * and return a dynamically allocated copy of the resultant string. */
-char *encode_data(char *buf, size_t buf_len)
+/* Return a copy of the given stretch of text (which is of the given length),
+ * with any NUL bytes in it encoded as newlines -- carved from the arena of
+ * the given splitter when it has one, and dynamically allocated otherwise. */
+char *encode_data(splitstruct *split, const char *text, size_t length)
+{
+	char *data;
+
+#ifndef NANO_TINY
+	if (split->arena != NULL)
+		data = carve(split->arena, length + 1, FALSE);
+	else
+#endif
+		data = charalloc(length + 1);
+
+	memcpy(data, text, length);
+	unsunder(data, length);
+	data[length] = '\0';
+
+	return data;
+}
+
+/* Create a new node for the list of lines of the given splitter -- in its
+ * arena when it has one.  Note that we do not set prevnode->next. */
+linestruct *make_split_node(splitstruct *split, linestruct *prevnode)
+{
+#ifndef NANO_TINY
+	if (split->arena != NULL)
+		return make_arena_node(split->arena, prevnode);
+#endif
+	return make_new_node(prevnode);
+}
+
+/* Return the given stretch of text as the data for a line of the splitter:
+ * the stretch itself when the lines may keep their text in place (the byte
+ * after the stretch then becomes its terminator), and otherwise a copy. */
+char *line_data(splitstruct *split, const char *text, size_t length)
+{
+#ifndef NANO_TINY
+	if (split->in_place) {
+		char *data = (char *)text;
+
+		unsunder(data, length);
+		data[length] = '\0';
+
+		return data;
+	}
+#endif
+	return encode_data(split, text, length);
+}
+
+/* Store the given stretch of text as the data of the bottom line of the
+ * splitter, and hang a new, empty line below it. */
+void store_line(splitstruct *split, const char *text, size_t length)
+{
+	split->bottomline->data = line_data(split, text, length);
+	split->bottomline->next = make_split_node(split, split->bottomline);
+	split->bottomline = split->bottomline->next;
+	split->num_lines++;
+}
+
+/* Cut the given text into lines and append these to the splitter's list.
+ * Return the number of bytes that were consumed: everything up to the start
+ * of the last, incomplete line.  When at_end is TRUE, this last line is
+ * stored too (as the data of the bottom line) and everything is consumed. */
+size_t split_into_lines(splitstruct *split, const char *text, size_t size,
+		bool at_end)
+{
+	const char *head = text;
+	const char *tail = text + size;
+	const char *brk;
+	bool also_cr;
+	size_t length;
+
+	while (TRUE) {
+#ifndef NANO_TINY
+		/* When we think it's a Mac file, or when we are on the first line,
+		 * a carriage return that is followed by something else than a newline
+		 * ends the line.  On other lines such a carriage return is normal. */
+		also_cr = (!ISSET(NO_CONVERT) && (split->num_lines == 0 || split->format != 0));
+#else
+		also_cr = FALSE;
+#endif
+		brk = find_break(head, tail, also_cr);
+
+		if (brk == NULL)
+			break;
+#ifndef NANO_TINY
+		if (*brk == '\r') {
+			/* A carriage return at the very end may still become DOS. */
+			if (brk + 1 == tail)
+				break;
+
+			if (brk[1] != '\n') {
+				split->format |= 2;
+				store_line(split, head, brk - head);
+				head = brk + 1;
+				continue;
+			}
+
+			/* A carriage return right before the newline makes it DOS. */
+			split->format |= 1;
+			brk++;
+		}
+#endif
+		length = brk - head;
+#ifndef NANO_TINY
+		/* If it's a DOS or Mac line, strip the '\r' from it. */
+		if (length > 0 && head[length - 1] == '\r' && !ISSET(NO_CONVERT))
+			length--;
+#endif
+		store_line(split, head, length);
+		head = brk + 1;
+	}
+
+	if (!at_end)
+		return head - text;
+
+	length = tail - head;
+
+	/* If the text ended with a newline, or it was entirely empty, make the
+	 * last line blank.  Otherwise, put the remaining data in. */
+	if (length == 0) {
+		split->bottomline->data = encode_data(split, "", 0);
+		return size;
+	}
+
+#ifndef NANO_TINY
+	/* If the final character is '\r', and file conversion isn't disabled,
+	 * set format to Mac if we currently think the file is a *nix file, or
+	 * to DOS-and-Mac if we currently think it is a DOS file.  Then strip
+	 * the carriage return, and put a blank line in after this one. */
+	if (tail[-1] == '\r' && !ISSET(NO_CONVERT)) {
+		split->format |= 2;
+		store_line(split, head, length - 1);
+		split->bottomline->data = encode_data(split, "", 0);
+		return size;
+	}
+#endif
+
+	/* Store the data of the final line. */
+	split->bottomline->data = line_data(split, head, length);
+	split->num_lines++;
+
+	return size;
+}
+
+#ifndef NANO_TINY
+/* Read the file with the given descriptor (of the given size) into a single
+ * block of the splitter's arena, a lump at a time, and split off the lines
+ * as they get completed -- the lines keep their text right there, so none
+ * of it gets copied.  Return zero when all went well, and an errno otherwise. */
+int read_in_place(int fd, splitstruct *split, size_t size)
+{
+	char *text = carve(split->arena, size + 1, FALSE);
+	size_t got = 0, done = 0, span = LUMPSIZE, used;
+	ssize_t piece = 0;
+
+	split->in_place = TRUE;
+
+	while (got < size) {
+		piece = read(fd, text + got, (size - got < LUMPSIZE) ? size - got : LUMPSIZE);
+
+		if (piece < 0 && errno == EINTR)
+			continue;
+		if (piece <= 0)
+			break;
+
+		got += piece;
+
+		if (control_C_was_pressed) {
+			statusline(ALERT, _("Interrupted"));
+			break;
+		}
+
+		/* When a line is longer than a lump, widen the lump. */
+		if (got - done < span && got < size)
+			continue;
+
+		used = split_into_lines(split, text + done, got - done, FALSE);
+		span = (used == 0) ? 2 * span : LUMPSIZE;
+		done += used;
+	}
+
+	/* The extra byte at the end of the block can terminate the last line. */
+	split_into_lines(split, text + done, got - done, TRUE);
+	split->in_place = FALSE;
+
+	return (piece < 0) ? errno : 0;
+}
+#endif
+
+/* Feed the entire contents of the given stream to the line splitter: in one
+ * go when it is a regular file that can be mapped into memory, and otherwise
+ * in big chunks.  Return zero when all went well, and an errno otherwise. */
+int slurp_into_lines(FILE *f, splitstruct *split)
+{
+	int fd = fileno(f);
+	char *buffer;
+	size_t bufsize = LUMPSIZE;
+	size_t kept = 0;
+		/* The number of bytes of an incomplete line at the start of buffer. */
+	ssize_t got;
+#if !defined(NANO_TINY) || defined(HAVE_SYS_MMAN_H)
+	struct stat fileinfo;
+	bool regular = (fstat(fd, &fileinfo) == 0 && S_ISREG(fileinfo.st_mode) &&
+				fileinfo.st_size > 0 && (off_t)(size_t)fileinfo.st_size == fileinfo.st_size);
+#endif
+
+#ifndef NANO_TINY
+	/* When a file is not small and has an arena, its lines can keep their
+	 * text in one block of that arena instead of each getting a copy. */
+	if (regular && split->arena != NULL && fileinfo.st_size >= LUMPSIZE)
+		return read_in_place(fd, split, fileinfo.st_size);
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+	if (regular) {
+		size_t size = fileinfo.st_size, done = 0, span = LUMPSIZE;
+		size_t end = size;
+		char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			madvise(map, size, MADV_SEQUENTIAL);
+
+			/* Split the mapped file a lump at a time, so that ^C can work.
+			 * When a line is longer than a lump, widen the lump. */
+			while (done + span < size) {
+				size_t used = split_into_lines(split, map + done, span, FALSE);
+
+				/* When interrupted, the rest of this lump is the last line. */
+				if (control_C_was_pressed) {
+					statusline(ALERT, _("Interrupted"));
+					end = done + span;
+					done += used;
+					break;
+				}
+
+				if (used == 0)
+					span *= 2;
+				else {
+					done += used;
+					span = LUMPSIZE;
+				}
+			}
+
+			split_into_lines(split, map + done, end - done, TRUE);
+			munmap(map, size);
+			return 0;
+		}
+	}
+#endif
+
+	buffer = charalloc(bufsize);
+
+	/* Read the stream in big lumps, and keep any incomplete last line
+	 * of a lump at the start of the buffer for the next round. */
+	while ((got = read(fd, buffer + kept, bufsize - kept)) != 0) {
+		size_t used;
+
+		if (control_C_was_pressed) {
+			statusline(ALERT, _("Interrupted"));
+			break;
+		}
+
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buffer);
+			return errno;
+		}
+
+		kept += got;
+		used = split_into_lines(split, buffer, kept, FALSE);
+		kept -= used;
+		memmove(buffer, buffer + used, kept);
+
+		/* When the buffer is full with a single line, double its size. */
+		if (kept == bufsize) {
+			bufsize *= 2;
+			buffer = charealloc(buffer, bufsize);
+		}
+	}
+
+	split_into_lines(split, buffer, kept, TRUE);
+	free(buffer);
+
+	return 0;
+}
+
+#ifdef USE_ZLIB
+/* Return TRUE when the given descriptor refers to a regular file that
+ * starts with the magic bytes of gzip, without disturbing its offset. */
+bool is_gzipped(int fd)
+{
+	unsigned char magic[2];
+	struct stat fileinfo;
+
+	return (fstat(fd, &fileinfo) == 0 && S_ISREG(fileinfo.st_mode) &&
+				pread(fd, magic, 2, 0) == 2 &&
+				magic[0] == 0x1F && magic[1] == 0x8B);
+}
+
+/* Decompress the gzipped contents of the given stream a lump at a time,
+ * and feed the resulting text to the line splitter, without any temporary
+ * file.  Return zero when all went well, and an errno otherwise. */
+int inflate_into_lines(FILE *f, splitstruct *split)
+{
+	int fd = fileno(f);
+	char *input = charalloc(LUMPSIZE);
+	size_t bufsize = LUMPSIZE;
+	char *buffer = charalloc(bufsize);
+	size_t kept = 0;
+		/* The number of bytes of an incomplete line at the start of buffer. */
+	bool ended = FALSE;
+		/* Whether the decompressor is between two gzip members. */
+	int errornumber = 0;
+	z_stream packed;
+	ssize_t got;
+
+	packed.zalloc = Z_NULL;
+	packed.zfree = Z_NULL;
+	packed.opaque = Z_NULL;
+	packed.next_in = Z_NULL;
+	packed.avail_in = 0;
+
+	/* Adding 16 to the window size makes zlib expect a gzip wrapper. */
+	if (inflateInit2(&packed, 15 + 16) != Z_OK) {
+		free(input);
+		free(buffer);
+		return ENOMEM;
+	}
+
+	while (TRUE) {
+		size_t used;
+		int status;
+
+		if (packed.avail_in == 0) {
+			got = read(fd, input, LUMPSIZE);
+
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got < 0)
+				errornumber = errno;
+			if (got <= 0)
+				break;
+
+			packed.next_in = (Bytef *)input;
+			packed.avail_in = got;
+		}
+
+		if (control_C_was_pressed) {
+			statusline(ALERT, _("Interrupted"));
+			ended = TRUE;
+			break;
+		}
+
+		packed.next_out = (Bytef *)buffer + kept;
+		packed.avail_out = bufsize - kept;
+
+		status = inflate(&packed, Z_NO_FLUSH);
+
+		/* A gzipped file may consist of several members, one after another;
+		 * but treat anything after a complete member that is not another
+		 * member as mere padding. */
+		if (status == Z_STREAM_END) {
+			ended = TRUE;
+			inflateReset(&packed);
+		} else if (status == Z_OK)
+			ended = FALSE;
+		else if (!ended || status != Z_DATA_ERROR) {
+			statusline(ALERT, _("Damaged gzip data: %s"),
+						packed.msg ? packed.msg : _("unknown error"));
+			ended = TRUE;
+			break;
+		} else
+			break;
+
+		kept = bufsize - packed.avail_out;
+		used = split_into_lines(split, buffer, kept, FALSE);
+		kept -= used;
+		memmove(buffer, buffer + used, kept);
+
+		/* When the buffer is full with a single line, double its size. */
+		if (kept == bufsize) {
+			bufsize *= 2;
+			buffer = charealloc(buffer, bufsize);
+		}
+	}
+
+	if (!ended && errornumber == 0)
+		statusline(ALERT, _("Damaged gzip data: %s"), _("unexpected end"));
+
+	split_into_lines(split, buffer, kept, TRUE);
+	inflateEnd(&packed);
+	free(buffer);
+	free(input);
+
+	return errornumber;
+}
+#endif
+
+#ifndef NANO_TINY
+/* Hand the lines that the worker has completed over to the main thread.
+ * When finished is TRUE, the bottom line (the final one) goes along too. */
+void hand_over_lines(loaderstruct *loader, bool finished)
+{
+	linestruct *top = loader->split.topline;
+	linestruct *bottom = loader->split.bottomline;
+
+	if (finished)
+		loader->split.topline = NULL;
+	else {
+		bottom = bottom->prev;
+
+		/* When no line was completed, there is nothing to hand over. */
+		if (bottom == NULL)
+			return;
+
+		bottom->next = NULL;
+		loader->split.bottomline->prev = NULL;
+		loader->split.topline = loader->split.bottomline;
+	}
+
+	pthread_mutex_lock(&loader->lock);
+
+	/* The blocks that the new lines were carved from go along with them. */
+	if (loader->split.arena->fresh != NULL) {
+		blockstruct *block = loader->split.arena->fresh;
+
+		while (block->next != NULL)
+			block = block->next;
+
+		block->next = loader->readyblocks;
+		loader->readyblocks = loader->split.arena->fresh;
+		loader->split.arena->fresh = NULL;
+	}
+
+	if (loader->readytop == NULL)
+		loader->readytop = top;
+	else {
+		loader->readybot->next = top;
+		top->prev = loader->readybot;
+	}
+	loader->readybot = bottom;
+	loader->finished = finished;
+
+	pthread_cond_signal(&loader->arrival);
+	pthread_mutex_unlock(&loader->lock);
+}
+
+/* Read the rest of the file into its block, a lump at a time, split it into
+ * lines that keep their text in place, and hand each batch of completed lines
+ * over to the main thread. */
+void *load_the_rest(void *the_loader)
+{
+	loaderstruct *loader = the_loader;
+	size_t span = LUMPSIZE, lump, used;
+	ssize_t piece;
+	bool stop;
+
+	while (loader->got < loader->size) {
+		lump = loader->size - loader->got;
+		piece = pread(loader->fd, loader->map + loader->got,
+						(lump < LUMPSIZE) ? lump : LUMPSIZE, loader->got);
+
+		if (piece < 0 && errno == EINTR)
+			continue;
+		if (piece <= 0)
+			break;
+
+		loader->got += piece;
+
+		/* When a line is longer than a lump, widen the lump. */
+		if (loader->got - loader->done < span && loader->got < loader->size)
+			continue;
+
+		used = split_into_lines(&loader->split, loader->map + loader->done,
+								loader->got - loader->done, FALSE);
+		if (used == 0) {
+			span *= 2;
+			continue;
+		}
+
+		loader->done += used;
+		span = LUMPSIZE;
+
+		hand_over_lines(loader, FALSE);
+
+		pthread_mutex_lock(&loader->lock);
+		stop = loader->stop;
+		pthread_mutex_unlock(&loader->lock);
+
+		if (stop)
+			return NULL;
+	}
+
+	split_into_lines(&loader->split, loader->map + loader->done,
+								loader->got - loader->done, TRUE);
+	hand_over_lines(loader, TRUE);
+
+	return NULL;
+}
+
+/* Read the stream of the given loader as the data trickles in, and hand each
+ * batch of completed lines over to the main thread, until the stream ends or
+ * the main thread says to stop -- then the last line is handed over too. */
+void *stream_the_rest(void *the_loader)
+{
+	loaderstruct *loader = the_loader;
+	struct pollfd waiter = {loader->fd, POLLIN, 0};
+	size_t bufsize = LUMPSIZE;
+	char *buffer = charalloc(bufsize);
+	size_t kept = 0;
+		/* The number of bytes of an incomplete line at the start of buffer. */
+	ssize_t got;
+	bool stop;
+
+	while (TRUE) {
+		pthread_mutex_lock(&loader->lock);
+		stop = loader->stop;
+		pthread_mutex_unlock(&loader->lock);
+
+		if (stop)
+			break;
+
+		/* Wait just a short while, so that a request to stop gets seen. */
+		if (poll(&waiter, 1, 100) < 1)
+			continue;
+
+		got = read(loader->fd, buffer + kept, bufsize - kept);
+
+		if (got < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (got <= 0)
+			break;
+
+		kept += got;
+		got = split_into_lines(&loader->split, buffer, kept, FALSE);
+		kept -= got;
+		memmove(buffer, buffer + got, kept);
+
+		/* When the buffer is full with a single line, double its size. */
+		if (kept == bufsize) {
+			bufsize *= 2;
+			buffer = charealloc(buffer, bufsize);
+		}
+
+		hand_over_lines(loader, FALSE);
+	}
+
+	split_into_lines(&loader->split, buffer, kept, TRUE);
+	hand_over_lines(loader, TRUE);
+
+	free(buffer);
+
+	return NULL;
+}
+
+/* If the given file is big enough to make it worthwhile, read just its first
+ * lump into a block of the arena, split that into lines, and return a loader
+ * that can read the rest into the same block in the background.  Otherwise,
+ * return NULL. */
+loaderstruct *begin_loading(FILE *f, splitstruct *split)
+{
+	struct stat fileinfo;
+	loaderstruct *loader;
+	size_t size, used = 0;
+	ssize_t got;
+	char *map;
+	int fd;
+
+	if (fstat(fileno(f), &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode) ||
+				fileinfo.st_size <= 4 * LUMPSIZE ||
+				(off_t)(size_t)fileinfo.st_size != fileinfo.st_size)
+		return NULL;
+
+	/* Keep the file open also after the caller closes it. */
+	fd = dup(fileno(f));
+
+	if (fd < 0)
+		return NULL;
+
+	size = fileinfo.st_size;
+
+	/* The lines keep their text in this block, so it becomes part of the
+	 * arena of the buffer, with an extra byte to end the last line. */
+	map = carve(split->arena, size + 1, FALSE);
+
+	do
+		got = pread(fd, map, LUMPSIZE, 0);
+	while (got < 0 && errno == EINTR);
+
+	/* Split off the lines of the first lump -- when the first line is longer
+	 * than that, the buffer starts out empty, like for a stream. */
+	if (got > 0) {
+		split->in_place = TRUE;
+		used = split_into_lines(split, map, got, FALSE);
+		split->in_place = FALSE;
+	} else
+		got = 0;
+
+	/* For the time being, let the buffer end with an empty line. */
+	split->bottomline->data = encode_data(split, "", 0);
+
+	loader = nmalloc(sizeof(loaderstruct));
+
+	loader->fd = fd;
+	loader->map = map;
+	loader->size = size;
+	loader->got = got;
+	loader->done = used;
+
+	/* The worker continues where the main thread stopped, in an arena
+	 * of its own, as the blocks of an arena should not be shared. */
+	loader->split.arena = make_arena();
+	loader->split.topline = make_split_node(&loader->split, NULL);
+	loader->split.bottomline = loader->split.topline;
+	loader->split.num_lines = split->num_lines;
+	loader->split.format = split->format;
+	loader->split.in_place = TRUE;
+
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->arrival, NULL);
+
+	loader->readytop = NULL;
+	loader->readybot = NULL;
+	loader->readyblocks = NULL;
+	loader->finished = FALSE;
+	loader->stop = FALSE;
+
+	return loader;
+}
+
+/* Return a loader that reads the given stream in the background, so that
+ * its first lines can be shown while the rest is still on its way. */
+loaderstruct *begin_streaming(FILE *f, splitstruct *split)
+{
+	loaderstruct *loader = nmalloc(sizeof(loaderstruct));
+
+	/* Keep the stream open also after the caller closes it. */
+	loader->fd = dup(fileno(f));
+
+	if (loader->fd < 0) {
+		free(loader);
+		return NULL;
+	}
+
+	/* Until the first lines arrive, the buffer holds an empty line. */
+	split->bottomline->data = encode_data(split, "", 0);
+
+	loader->map = NULL;
+	loader->size = 0;
+	loader->got = 0;
+	loader->done = 0;
+
+	loader->split.arena = make_arena();
+	loader->split.topline = make_split_node(&loader->split, NULL);
+	loader->split.bottomline = loader->split.topline;
+	loader->split.num_lines = 0;
+	loader->split.format = 0;
+	loader->split.in_place = FALSE;
+
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->arrival, NULL);
+
+	loader->readytop = NULL;
+	loader->readybot = NULL;
+	loader->readyblocks = NULL;
+	loader->finished = FALSE;
+	loader->stop = FALSE;
+
+	return loader;
+}
+
+/* Let the given loader read the rest of its file into the current buffer,
+ * in a separate thread, so that the user can look around in the meantime. */
+void start_loading(loaderstruct *loader)
+{
+	sigset_t allsignals, oldmask;
+
+	openfile->loader = loader;
+	files_loading++;
+
+	/* Keep all signals away from the worker: they are for the main thread. */
+	sigfillset(&allsignals);
+	pthread_sigmask(SIG_SETMASK, &allsignals, &oldmask);
+
+	loader->threaded = (pthread_create(&loader->thread, NULL, (loader->map != NULL) ?
+										load_the_rest : stream_the_rest, loader) == 0);
+
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+	/* When no thread could be started, do all the work here and now. */
+	if (!loader->threaded) {
+		if (loader->map != NULL)
+			load_the_rest(loader);
+		else
+			stream_the_rest(loader);
+		take_in_lines(openfile);
+	}
+}
+
+/* Close the file or stream that the given loader was reading.  The block
+ * that a file was read into stays: it holds the text of the lines. */
+void release_source(loaderstruct *loader)
+{
+	close(loader->fd);
+}
+
+/* Clean up after the loader of the given buffer has finished its work,
+ * and report the number of lines that were read. */
+void finish_loading(openfilestruct *buffer)
+{
+	loaderstruct *loader = buffer->loader;
+	int format = loader->split.format;
+
+	if (loader->threaded)
+		pthread_join(loader->thread, NULL);
+
+	pthread_mutex_destroy(&loader->lock);
+	pthread_cond_destroy(&loader->arrival);
+	release_source(loader);
+
+	adopt_blocks(buffer->arena, &loader->split.arena->fresh);
+	free_arena(loader->split.arena);
+
+	/* If the file doesn't end with a newline, and it should, add one. */
+	if (!ISSET(NO_NEWLINES) && buffer->filebot->data[0] != '\0') {
+		buffer->filebot->next = make_text_node(buffer->filebot, "");
+		buffer->filebot = buffer->filebot->next;
+		buffer->totsize++;
+	}
+
+	if (loader->writable && format == 2)
+		buffer->fmt = MAC_FILE;
+	else if (loader->writable && format == 1)
+		buffer->fmt = DOS_FILE;
+
+	if (ISSET(MAKE_IT_UNIX))
+		buffer->fmt = NIX_FILE;
+
+#ifdef ENABLE_COLOR
+	/* The multiline coloring info was computed for a partial file, so
+	 * discard it, and recompute it when the buffer is on display. */
+	if (buffer->filetop->multidata != NULL) {
+		discard_multicolorinfo(buffer->filetop);
+
+		if (buffer == openfile)
+			precalc_multicolorinfo();
+	}
+#endif
+
+	if (buffer == openfile && currmenu == MMAIN) {
+		if (!loader->writable)
+			statusline(ALERT, _("File '%s' is unwritable"), buffer->filename);
+		else
+			report_lines_read(loader->split.num_lines, format);
+	}
+
+	buffer->loader = NULL;
+	files_loading--;
+
+	free(loader);
+}
+
+/* Add the lines that the loader of the given buffer has handed over so far
+ * to the end of that buffer, in front of its provisional last line.  When
+ * the loader has finished, its final line replaces the provisional one. */
+void take_in_lines(openfilestruct *buffer)
+{
+	loaderstruct *loader = buffer->loader;
+	linestruct *lastline = buffer->filebot;
+	linestruct *top, *bottom;
+	blockstruct *blocks;
+	bool finished;
+
+	pthread_mutex_lock(&loader->lock);
+	top = loader->readytop;
+	bottom = loader->readybot;
+	blocks = loader->readyblocks;
+	finished = loader->finished;
+	loader->readytop = NULL;
+	loader->readybot = NULL;
+	loader->readyblocks = NULL;
+	pthread_mutex_unlock(&loader->lock);
+
+	/* Let the pieces of the new lines be recognized as part of the buffer. */
+	adopt_blocks(buffer->arena, &blocks);
+
+	if (top == NULL)
+		return;
+
+	if (finished) {
+		linestruct *final = bottom;
+
+		set_data(lastline, final->data);
+		final->data = NULL;
+		buffer->totsize += mbstrlen(lastline->data);
+
+		bottom = final->prev;
+		if (bottom == NULL)
+			top = NULL;
+		else
+			bottom->next = NULL;
+
+		delete_node(final);
+	}
+
+	if (top != NULL) {
+		top->prev = lastline->prev;
+		if (lastline->prev != NULL)
+			lastline->prev->next = top;
+		bottom->next = lastline;
+		lastline->prev = bottom;
+
+		/* When the first lines of a stream arrive, they go on top. */
+		if (buffer->filetop == lastline) {
+			buffer->filetop = top;
+			if (buffer->edittop == lastline)
+				buffer->edittop = top;
+			if (buffer->current == lastline)
+				buffer->current = top;
+		}
+
+		renumber_from(top);
+		buffer->totsize += get_totsize(top, bottom);
+	}
+
+	/* What came from a stream exists nowhere else, so it needs saving. */
+	if (loader->map == NULL && !buffer->modified && !ISSET(VIEW_MODE) &&
+						buffer->totsize > 0) {
+		buffer->modified = TRUE;
+		if (buffer == openfile)
+			titlebar(NULL);
+	}
+
+	if (buffer == openfile)
+		refresh_needed = TRUE;
+
+	if (finished)
+		finish_loading(buffer);
+}
+
+/* Take in the lines that have arrived for any of the buffers. */
+void take_in_all_lines(void)
+{
+#ifdef ENABLE_MULTIBUFFER
+	openfilestruct *buffer = openfile;
+
+	do {
+		if (buffer->loader != NULL)
+			take_in_lines(buffer);
+		buffer = buffer->next;
+	} while (buffer != openfile);
+#else
+	if (openfile->loader != NULL)
+		take_in_lines(openfile);
+#endif
+}
+
+/* Wait a short while for the loader of the given buffer to hand over
+ * more lines, and take in whatever has arrived. */
+void wait_for_lines(openfilestruct *buffer)
+{
+	loaderstruct *loader = buffer->loader;
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += 100000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_nsec -= 1000000000;
+		deadline.tv_sec++;
+	}
+
+	pthread_mutex_lock(&loader->lock);
+	if (loader->readytop == NULL)
+		pthread_cond_timedwait(&loader->arrival, &loader->lock, &deadline);
+	pthread_mutex_unlock(&loader->lock);
+
+	take_in_lines(buffer);
+}
+
+/* Wait until the current buffer has been read in completely -- or, when
+ * lineno is not zero, until it contains that line as a complete line.
+ * Return FALSE when the waiting was cut short with ^C.  For a stream,
+ * ^C instead ends the reading, keeping what has arrived so far. */
+bool await_loading(ssize_t lineno)
+{
+	if (openfile->loader == NULL ||
+						(lineno > 0 && openfile->filebot->lineno > lineno))
+		return TRUE;
+
+	statusbar(_("Reading..."));
+
+	install_handler_for_Ctrl_C();
+	control_C_was_pressed = FALSE;
+
+	while (openfile->loader != NULL && !control_C_was_pressed &&
+						(lineno == 0 || openfile->filebot->lineno <= lineno))
+		wait_for_lines(openfile);
+
+	restore_handler_for_Ctrl_C();
+
+	/* When the reading finished meanwhile, the interruption is moot. */
+	if (control_C_was_pressed && openfile->loader != NULL) {
+		if (openfile->loader->map != NULL) {
+			statusline(ALERT, _("Interrupted"));
+			return FALSE;
+		}
+
+		/* For a stream, ^C means: stop reading, and keep what came in. */
+		end_streaming();
+	}
+
+	return TRUE;
+}
+
+/* Make the stream that is being read into the current buffer stop
+ * trickling in, and keep the lines that arrived so far. */
+void end_streaming(void)
+{
+	pthread_mutex_lock(&openfile->loader->lock);
+	openfile->loader->stop = TRUE;
+	pthread_mutex_unlock(&openfile->loader->lock);
+
+	while (openfile->loader != NULL)
+		wait_for_lines(openfile);
+}
+
+/* Make the loader of the given buffer give up, and discard what it read. */
+void stop_loading(openfilestruct *buffer)
+{
+	loaderstruct *loader = buffer->loader;
+
+	pthread_mutex_lock(&loader->lock);
+	loader->stop = TRUE;
+	pthread_mutex_unlock(&loader->lock);
+
+	if (loader->threaded)
+		pthread_join(loader->thread, NULL);
+
+	/* The lines that were not taken in were all carved from the worker's
+	 * arena, so they need no freeing: they go when the buffer's arena goes. */
+	adopt_blocks(buffer->arena, &loader->readyblocks);
+	adopt_blocks(buffer->arena, &loader->split.arena->fresh);
+	free_arena(loader->split.arena);
+
+	pthread_mutex_destroy(&loader->lock);
+	pthread_cond_destroy(&loader->arrival);
+	release_source(loader);
+
+	buffer->loader = NULL;
+	files_loading--;
+
+	free(loader);
+}
+
+/* Return TRUE when the two given states of a file are the same, down to
+ * the nanoseconds of their timestamps, as a rewrite may take less than
+ * a second and need not change the size. */
+bool same_file_state(const struct stat *one, const struct stat *other)
+{
+	return (one->st_dev == other->st_dev && one->st_ino == other->st_ino &&
+			one->st_size == other->st_size &&
+			one->st_mtim.tv_sec == other->st_mtim.tv_sec &&
+			one->st_mtim.tv_nsec == other->st_mtim.tv_nsec &&
+			one->st_ctim.tv_sec == other->st_ctim.tv_sec &&
+			one->st_ctim.tv_nsec == other->st_ctim.tv_nsec);
+}
+
+/* Read the files that nobody has claimed yet, one at a time, into lines. */
+void *prefetch_files(void *dummy)
+{
+	while (TRUE) {
+		fetchstruct *entry;
+		struct stat after;
+		char *text = NULL;
+		size_t got = 0;
+		ssize_t piece;
+		int fd;
+
+		pthread_mutex_lock(&prefetch->lock);
+		while (prefetch->next < prefetch->count &&
+						prefetch->files[prefetch->next].claimed)
+			prefetch->next++;
+		if (prefetch->next == prefetch->count) {
+			pthread_mutex_unlock(&prefetch->lock);
+			return NULL;
+		}
+		entry = &prefetch->files[prefetch->next++];
+		entry->claimed = TRUE;
+		pthread_mutex_unlock(&prefetch->lock);
+
+		fd = open(entry->filename, O_RDONLY);
+
+		/* Read just regular files that are not big: big ones are read
+		 * in the background anyway, once their buffer is opened. */
+		if (fd >= 0 && fstat(fd, &entry->fileinfo) == 0 &&
+						S_ISREG(entry->fileinfo.st_mode) &&
+						entry->fileinfo.st_size <= 4 * LUMPSIZE) {
+			text = charalloc(entry->fileinfo.st_size + 1);
+
+			while ((piece = read(fd, text + got,
+							entry->fileinfo.st_size + 1 - got)) != 0) {
+				if (piece < 0 && errno == EINTR)
+					continue;
+				if (piece < 0)
+					break;
+				got += piece;
+				if (got > (size_t)entry->fileinfo.st_size)
+					break;
+			}
+		}
+
+		/* When the file was changed while it was being read, drop the text. */
+		if (text != NULL && (fstat(fd, &after) != 0 ||
+						!same_file_state(&after, &entry->fileinfo))) {
+			free(text);
+			text = NULL;
+		}
+
+		if (fd >= 0)
+			close(fd);
+
+		/* Split the text only when it is what the file holds in its entirety. */
+		if (text != NULL && got == (size_t)entry->fileinfo.st_size) {
+			entry->split.arena = make_arena();
+			entry->split.topline = make_split_node(&entry->split, NULL);
+			entry->split.bottomline = entry->split.topline;
+			entry->split.num_lines = 0;
+			entry->split.format = 0;
+			entry->split.in_place = FALSE;
+
+			split_into_lines(&entry->split, text, got, TRUE);
+		} else {
+			entry->split.arena = NULL;
+			entry->split.topline = NULL;
+		}
+
+		free(text);
+
+		pthread_mutex_lock(&prefetch->lock);
+		entry->ready = TRUE;
+		pthread_cond_broadcast(&prefetch->done);
+		pthread_mutex_unlock(&prefetch->lock);
+	}
+}
+
+/* Start some helpers that read the given files (as named on the command line,
+ * including any +LINE arguments) into lines, so that opening them is quick. */
+void start_prefetching(char **names, int count)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	sigset_t allsignals, oldmask;
+
+	prefetch = nmalloc(sizeof(prefetchstruct));
+	prefetch->files = nmalloc(count * sizeof(fetchstruct));
+	prefetch->count = 0;
+	prefetch->next = 0;
+
+	for (int index = 0; index < count; index++) {
+		/* Skip the +LINE,COLUMN arguments, and standard input. */
+		if ((index < count - 1 && names[index][0] == '+') ||
+						strcmp(names[index], "-") == 0)
+			continue;
+
+		prefetch->files[prefetch->count].filename = real_dir_from_tilde(names[index]);
+		prefetch->files[prefetch->count].claimed = FALSE;
+		prefetch->files[prefetch->count].ready = FALSE;
+		prefetch->count++;
+	}
+
+	pthread_mutex_init(&prefetch->lock, NULL);
+	pthread_cond_init(&prefetch->done, NULL);
+
+	prefetch->threadcount = (cores < 1) ? 1 : (cores > 8) ? 8 : cores;
+	if ((size_t)prefetch->threadcount > prefetch->count)
+		prefetch->threadcount = prefetch->count;
+
+	prefetch->threads = nmalloc(prefetch->threadcount * sizeof(pthread_t));
+
+	/* Keep all signals away from the helpers: they are for the main thread. */
+	sigfillset(&allsignals);
+	pthread_sigmask(SIG_SETMASK, &allsignals, &oldmask);
+
+	for (int index = 0; index < prefetch->threadcount; index++)
+		if (pthread_create(&prefetch->threads[index], NULL, prefetch_files, NULL) != 0) {
+			prefetch->threadcount = index;
+			break;
+		}
+
+	pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+/* If the file with the given name was read ahead, and it has not changed
+ * since, hand over its lines in split and return TRUE.  When nobody has
+ * started reading the file yet, let the caller do it, and return FALSE. */
+bool take_prefetched(const char *filename, FILE *f, splitstruct *split)
+{
+	fetchstruct *entry = NULL;
+	struct stat fileinfo;
+	bool unchanged;
+
+	pthread_mutex_lock(&prefetch->lock);
+
+	for (size_t index = 0; index < prefetch->count; index++)
+		if (prefetch->files[index].filename != NULL &&
+						strcmp(prefetch->files[index].filename, filename) == 0) {
+			entry = &prefetch->files[index];
+			break;
+		}
+
+	if (entry == NULL || !entry->claimed) {
+		if (entry != NULL)
+			entry->claimed = TRUE;
+		pthread_mutex_unlock(&prefetch->lock);
+		if (entry != NULL) {
+			free(entry->filename);
+			entry->filename = NULL;
+		}
+		return FALSE;
+	}
+
+	while (!entry->ready)
+		pthread_cond_wait(&prefetch->done, &prefetch->lock);
+
+	pthread_mutex_unlock(&prefetch->lock);
+
+	free(entry->filename);
+	entry->filename = NULL;
+
+	if (entry->split.topline == NULL)
+		return FALSE;
+
+	unchanged = (fstat(fileno(f), &fileinfo) == 0 &&
+						same_file_state(&fileinfo, &entry->fileinfo));
+
+	/* All lines were carved from the arena, so it is enough to free that. */
+	if (!unchanged) {
+		free_arena(entry->split.arena);
+		return FALSE;
+	}
+
+	free_arena(split->arena);
+	*split = entry->split;
+
+	return TRUE;
+}
+
+/* Wait for the helpers to finish, and discard what did not get used. */
+void stop_prefetching(void)
+{
+	pthread_mutex_lock(&prefetch->lock);
+	prefetch->next = prefetch->count;
+	pthread_mutex_unlock(&prefetch->lock);
+
+	for (int index = 0; index < prefetch->threadcount; index++)
+		pthread_join(prefetch->threads[index], NULL);
+
+	for (size_t index = 0; index < prefetch->count; index++)
+		if (prefetch->files[index].filename != NULL) {
+			if (prefetch->files[index].ready &&
+						prefetch->files[index].split.arena != NULL)
+				free_arena(prefetch->files[index].split.arena);
+			free(prefetch->files[index].filename);
+		}
+
+	pthread_mutex_destroy(&prefetch->lock);
+	pthread_cond_destroy(&prefetch->done);
+
+	free(prefetch->threads);
+	free(prefetch->files);
+	free(prefetch);
+	prefetch = NULL;
+}
+#endif /* !NANO_TINY */
+
+#ifndef NANO_TINY
+/* If the given file is big enough to make it worthwhile, map it into memory
+ * and return a window onto it, through which just a part of it is read in
+ * at any time.  Otherwise, return NULL. */
+windowstruct *open_window(FILE *f)
+{
+#ifdef HAVE_SYS_MMAN_H
+	size_t threshold = WINDOWTHRESHOLD;
+	struct stat fileinfo;
+	windowstruct *window;
+	char *map;
+
+	/* When editing, read in whole any file that fits easily in memory. */
+	if (!ISSET(VIEW_MODE)) {
+#ifdef _SC_PHYS_PAGES
+		long pages = sysconf(_SC_PHYS_PAGES);
+
+		if (pages > 0 && (size_t)pages / 4 * sysconf(_SC_PAGESIZE) > threshold)
+			threshold = (size_t)pages / 4 * sysconf(_SC_PAGESIZE);
+#else
+		threshold = HIGHEST_POSITIVE;
+#endif
+	}
+
+	if (fstat(fileno(f), &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode) ||
+				(size_t)fileinfo.st_size <= threshold ||
+				(off_t)(size_t)fileinfo.st_size != fileinfo.st_size)
+		return NULL;
+
+	map = mmap(NULL, fileinfo.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	window = nmalloc(sizeof(windowstruct));
+
+	window->map = map;
+	window->size = fileinfo.st_size;
+	window->startbyte = 0;
+	window->endbyte = 0;
+	window->topline = 1;
+	window->bottomline = 0;
+	window->format = 0;
+
+	/* The first line break determines how the other lines end. */
+	if (!ISSET(NO_CONVERT)) {
+		const char *brk = find_break(map, map + window->size, TRUE);
+
+		if (brk != NULL && *brk == '\r')
+			window->format = (brk + 1 < map + window->size && brk[1] == '\n') ? 1 : 2;
+	}
+
+	window->filefmt = (window->format == 2) ? MAC_FILE :
+						(window->format == 1) ? DOS_FILE : NIX_FILE;
+	window->device = fileinfo.st_dev;
+	window->inode = fileinfo.st_ino;
+
+	window->also_cr = (window->format != 0);
+
+	window->checkpoints = nmalloc(CHECKSTEP * sizeof(size_t));
+	window->checkpoints[0] = 0;
+	window->checkcount = 1;
+	window->lastline = 0;
+	window->dropped = NULL;
+
+	return window;
+#else
+	return NULL;
+#endif
+}
+
+/* Release the given window and the mapping behind it. */
+void close_window(windowstruct *window)
+{
+	free_lines(window->dropped);
+	free(window->checkpoints);
+#ifdef HAVE_SYS_MMAN_H
+	munmap(window->map, window->size);
+#endif
+	free(window);
+}
+
+/* Return where in the windowed file the line after the one that begins
+ * at pos begins, or NOWHERE when the line at pos is the last one. */
+size_t next_line_start(windowstruct *window, size_t pos)
+{
+	const char *head = window->map + pos;
+	const char *tail = window->map + window->size;
+	const char *brk = find_break(head, tail,
+							(pos == 0) ? !ISSET(NO_CONVERT) : window->also_cr);
+
+	if (brk == NULL) {
+		/* A carriage return at the very end counts as a line break. */
+		if (tail > head && tail[-1] == '\r' && !ISSET(NO_CONVERT))
+			return window->size;
+		return NOWHERE;
+	}
+
+	if (*brk == '\r' && brk + 1 < tail && brk[1] == '\n')
+		brk++;
+
+	return brk + 1 - window->map;
+}
+
+/* Return where in the windowed file the line with the given number begins,
+ * recording checkpoints on the way.  When the file has fewer lines, take
+ * note of how many it has, and return NOWHERE.  Also return NOWHERE when
+ * a long scan gets interrupted with ^C. */
+size_t line_start(windowstruct *window, ssize_t lineno)
+{
+	size_t index = (lineno - 1) / CHECKSTEP;
+	size_t pos;
+	ssize_t number;
+
+	if (window->lastline > 0 && lineno > window->lastline)
+		return NOWHERE;
+
+	if (index >= window->checkcount)
+		index = window->checkcount - 1;
+
+	number = index * CHECKSTEP + 1;
+	pos = window->checkpoints[index];
+
+	if (lineno - number > 16 * CHECKSTEP)
+		statusbar(_("Scanning..."));
+
+	while (number < lineno) {
+		pos = next_line_start(window, pos);
+
+		if (pos == NOWHERE) {
+			window->lastline = number;
+			return NOWHERE;
+		}
+
+		if (++number == window->checkcount * CHECKSTEP + 1) {
+			if (window->checkcount % CHECKSTEP == 0)
+				window->checkpoints = nrealloc(window->checkpoints,
+						(window->checkcount + CHECKSTEP) * sizeof(size_t));
+			window->checkpoints[window->checkcount++] = pos;
+		}
+
+		if (control_C_was_pressed) {
+			statusline(ALERT, _("Interrupted"));
+			return NOWHERE;
+		}
+	}
+
+	return pos;
+}
+
+/* Return the number of the last line of the windowed file, scanning
+ * the file when needed.  Return zero when the scan got interrupted. */
+ssize_t last_line_number(windowstruct *window)
+{
+	if (window->lastline == 0)
+		line_start(window, PTRDIFF_MAX);
+
+	return window->lastline;
+}
+
+/* Return how many lines more the windowed buffer has than the stretch
+ * of the file that its lines were read from, through the edits made. */
+ssize_t window_shift(windowstruct *window)
+{
+	return openfile->filebot->lineno - window->bottomline;
+}
+
+/* Return the number of lines in the windowed buffer, or zero when not known. */
+ssize_t windowed_linecount(windowstruct *window)
+{
+	char final = window->map[window->size - 1];
+
+	if (window->endbyte == window->size)
+		return openfile->filebot->lineno;
+	else if (window->lastline == 0)
+		return 0;
+
+	/* Count also the empty line that gets added when the file has no
+	 * newline at the end, like it would be for a normal file. */
+	if (!ISSET(NO_NEWLINES) && final != '\n' && (final != '\r' || ISSET(NO_CONVERT)))
+		return window->lastline + window_shift(window) + 1;
+	else
+		return window->lastline + window_shift(window);
+}
+
+/* Return the number of lines of text in the windowed buffer, not counting
+ * an empty last line, or zero when this is not known yet. */
+size_t windowed_textlines(windowstruct *window)
+{
+	char final = window->map[window->size - 1];
+
+	if (window->endbyte == window->size)
+		return openfile->filebot->lineno - (openfile->filebot->data[0] == '\0' ? 1 : 0);
+	else if (window->lastline == 0)
+		return 0;
+
+	return window->lastline + window_shift(window) - ((final == '\n' ||
+					(final == '\r' && !ISSET(NO_CONVERT))) ? 1 : 0);
+}
+
+/* Read the lines between the given start and end of the windowed file into
+ * a new list, numbering them from lineno onward.  Return the first line of
+ * the list, and set bottom to its last line. */
+linestruct *page_in(windowstruct *window, size_t start, size_t end,
+		ssize_t lineno, linestruct **bottom)
+{
+	bool at_end = (end == window->size);
+	splitstruct split;
+
+	split.topline = make_new_node(NULL);
+	split.bottomline = split.topline;
+	split.num_lines = (start == 0) ? 0 : 1;
+	split.format = window->format;
+	split.arena = NULL;
+	split.in_place = FALSE;
+
+	/* Let the splitter see that a final carriage return is a lone one. */
+	if (!at_end && window->map[end - 1] == '\r')
+		split_into_lines(&split, window->map + start, end + 1 - start, FALSE);
+	else
+		split_into_lines(&split, window->map + start, end - start, at_end);
+
+	window->format |= split.format;
+
+	/* Remove the empty line that the splitter left at the bottom. */
+	if (!at_end) {
+		split.bottomline = split.bottomline->prev;
+		delete_node(split.bottomline->next);
+		split.bottomline->next = NULL;
+	} else if (!ISSET(NO_NEWLINES) && split.bottomline->data[0] != '\0') {
+		split.bottomline->next = make_text_node(split.bottomline, "");
+		split.bottomline = split.bottomline->next;
+	}
+
+	for (linestruct *line = split.topline; line != NULL; line = line->next)
+		line->lineno = lineno++;
+
+	*bottom = split.bottomline;
+
+	return split.topline;
+}
+
+/* Move the given list of lines onto the pile of lines that left the window. */
+void drop_lines(windowstruct *window, linestruct *top, linestruct *bottom)
+{
+	bottom->next = window->dropped;
+	window->dropped = top;
+}
+
+/* Replace the lines in memory with the lines top to bottom of the file. */
+bool fill_window(ssize_t top, ssize_t bottom)
+{
+	windowstruct *window = openfile->window;
+	size_t start = line_start(window, top);
+	size_t end = line_start(window, bottom + 1);
+	linestruct *last;
+
+	if (start == NOWHERE || (end == NOWHERE && control_C_was_pressed))
+		return FALSE;
+
+	if (end == NOWHERE)
+		end = window->size;
+
+	drop_lines(window, openfile->filetop, openfile->filebot);
+
+	openfile->filetop = page_in(window, start, end, top, &last);
+	openfile->filebot = last;
+
+	window->startbyte = start;
+	window->endbyte = end;
+	window->topline = top;
+	window->bottomline = last->lineno;
+
+	return TRUE;
+}
+
+/* Add lines above the top of the window, to let it begin at the given line. */
+bool grow_window_up(ssize_t top)
+{
+	windowstruct *window = openfile->window;
+	linestruct *first, *last;
+	size_t start;
+
+	if (top >= openfile->filetop->lineno)
+		return TRUE;
+
+	start = line_start(window, top);
+
+	if (start == NOWHERE)
+		return FALSE;
+
+	first = page_in(window, start, window->startbyte, top, &last);
+
+	last->next = openfile->filetop;
+	openfile->filetop->prev = last;
+	openfile->filetop = first;
+
+	window->startbyte = start;
+	window->topline = top;
+
+	return TRUE;
+}
+
+/* Add lines below the bottom of the window, to let it end at the given line. */
+bool grow_window_down(ssize_t bottom)
+{
+	windowstruct *window = openfile->window;
+	ssize_t shift = window_shift(window);
+	linestruct *first, *last;
+	size_t end;
+
+	if (bottom <= openfile->filebot->lineno || window->endbyte == window->size)
+		return TRUE;
+
+	end = line_start(window, bottom - shift + 1);
+
+	if (end == NOWHERE && control_C_was_pressed)
+		return FALSE;
+
+	if (end == NOWHERE)
+		end = window->size;
+
+	first = page_in(window, window->endbyte, end, openfile->filebot->lineno + 1, &last);
+
+	openfile->filebot->next = first;
+	first->prev = openfile->filebot;
+	openfile->filebot = last;
+
+	window->endbyte = end;
+	window->bottomline = last->lineno - shift;
+
+	return TRUE;
+}
+
+/* Let the window begin at the given line, dropping the lines above it. */
+void shrink_window_top(ssize_t top)
+{
+	windowstruct *window = openfile->window;
+	linestruct *line = openfile->filetop;
+
+	if (top <= line->lineno)
+		return;
+
+	while (line->lineno < top)
+		line = line->next;
+
+	window->startbyte = line_start(window, top);
+	window->topline = top;
+
+	line->prev->next = NULL;
+	drop_lines(window, openfile->filetop, line->prev);
+	line->prev = NULL;
+	openfile->filetop = line;
+}
+
+/* Let the window end at the given line, dropping the lines below it. */
+void shrink_window_bottom(ssize_t bottom)
+{
+	windowstruct *window = openfile->window;
+	linestruct *line = openfile->filebot;
+	size_t end;
+
+	if (bottom >= line->lineno)
+		return;
+
+	end = line_start(window, bottom + 1);
+
+	/* An added empty line at the end of the file is not dropped alone. */
+	if (end == NOWHERE)
+		return;
+
+	while (line->lineno > bottom)
+		line = line->prev;
+
+	drop_lines(window, line->next, openfile->filebot);
+	line->next = NULL;
+	openfile->filebot = line;
+
+	window->endbyte = end;
+	window->bottomline = bottom;
+}
+
+/* Bring the given line of the windowed buffer into memory, together with the
+ * lines around it, and return it.  Return NULL when interrupted, or when it
+ * would take too many lines to keep also the unsaved changes in memory. */
+linestruct *move_window_to(ssize_t lineno)
+{
+	windowstruct *window = openfile->window;
+	ssize_t shift = window_shift(window);
+	ssize_t top, bottom;
+	linestruct *line;
+
+	/* When the file does not have that many lines, go to the last one. */
+	if (lineno > openfile->filebot->lineno &&
+				line_start(window, lineno - shift) == NOWHERE) {
+		if (window->lastline == 0 || lineno - shift <= window->lastline)
+			return NULL;
+		lineno = window->lastline + shift;
+	}
+
+	top = (lineno > WINDOWLINES / 2) ? lineno - WINDOWLINES / 2 : 1;
+	bottom = top + WINDOWLINES - 1;
+
+	/* Edited lines may not leave memory, so then the window can only grow;
+	 * otherwise, when the new stretch does not overlap the old one, start
+	 * afresh, or else add what is needed and drop what is no longer needed. */
+	if (openfile->modified) {
+		if (top > openfile->filetop->lineno)
+			top = openfile->filetop->lineno;
+		if (bottom < openfile->filebot->lineno)
+			bottom = openfile->filebot->lineno;
+
+		if (bottom - top >= MAXWINDOWLINES) {
+			statusline(ALERT, _("Too far from the unsaved changes -- save first"));
+			return NULL;
+		}
+
+		if (!grow_window_up(top) || !grow_window_down(bottom))
+			return NULL;
+	} else if (bottom < openfile->filetop->lineno || top > openfile->filebot->lineno) {
+		if (!fill_window(top, bottom))
+			return NULL;
+	} else {
+		if (!grow_window_up(top) || !grow_window_down(bottom))
+			return NULL;
+
+		shrink_window_top(top);
+		shrink_window_bottom(bottom);
+	}
+
+	/* Ensure that the cursor, the top of the screen, and the mark are
+	 * (still) on lines that are in memory. */
+	if (openfile->current->lineno < openfile->filetop->lineno ||
+				openfile->current->lineno > openfile->filebot->lineno) {
+		for (line = openfile->filetop; line->lineno < lineno; line = line->next)
+			;
+		openfile->current = line;
+		openfile->current_x = 0;
+		openfile->placewewant = 0;
+	}
+
+	if (openfile->edittop->lineno < openfile->filetop->lineno ||
+				openfile->edittop->lineno > openfile->filebot->lineno) {
+		/* Let the next refresh work out where the screen should start. */
+		openfile->edittop = openfile->filetop;
+		openfile->firstcolumn = 0;
+	}
+
+	if (openfile->mark && (openfile->mark->lineno < openfile->filetop->lineno ||
+				openfile->mark->lineno > openfile->filebot->lineno))
+		openfile->mark = NULL;
+
+	openfile->totsize = get_totsize(openfile->filetop, openfile->filebot);
+
+#ifdef ENABLE_COLOR
+	discard_multicolorinfo(openfile->filetop);
+	precalc_multicolorinfo();
+#endif
+	refresh_needed = TRUE;
+
+	for (line = openfile->filetop; line->lineno < lineno && line->next != NULL;)
+		line = line->next;
+
+	return line;
+}
+
+/* Make sure that there are enough lines in memory around the cursor, and
+ * free the lines that were dropped during the previous command. */
+void keep_window_around_cursor(void)
+{
+	windowstruct *window = openfile->window;
+	linestruct *current = openfile->current;
+
+	free_lines(window->dropped);
+	window->dropped = NULL;
+
+	control_C_was_pressed = FALSE;
+
+	if ((current->lineno - openfile->filetop->lineno >= WINDOWLINES / 4 ||
+						openfile->filetop->lineno == 1) &&
+				(openfile->filebot->lineno - current->lineno >= WINDOWLINES / 4 ||
+						window->endbyte == window->size))
+		return;
+
+	/* When the window cannot grow any more, complain only at its very edge. */
+	if (openfile->modified && openfile->filebot->lineno - openfile->filetop->lineno +
+						WINDOWLINES / 2 >= MAXWINDOWLINES &&
+						current != openfile->filetop && current != openfile->filebot)
+		return;
+
+	move_window_to(current->lineno);
+}
+
+/* When the current buffer is windowed, bring the given line into memory
+ * (or the last line, when lineno is zero).  Return FALSE when the needed
+ * scanning of the file was interrupted. */
+bool bring_in_line(ssize_t lineno)
+{
+	bool okay;
+
+	if (openfile->window == NULL)
+		return TRUE;
+
+	install_handler_for_Ctrl_C();
+	control_C_was_pressed = FALSE;
+
+	/* The last line of the file has a different number in the buffer
+	 * when lines were added or deleted. */
+	if (lineno == 0) {
+		lineno = last_line_number(openfile->window);
+		if (lineno > 0)
+			lineno += window_shift(openfile->window);
+	}
+
+	if (lineno >= openfile->filetop->lineno && lineno <= openfile->filebot->lineno)
+		okay = TRUE;
+	else
+		okay = (lineno > 0 && move_window_to(lineno) != NULL);
+
+	restore_handler_for_Ctrl_C();
+
+	return okay;
+}
+
+/* Put the first part of the given windowed file into the current buffer. */
+void start_window(windowstruct *window)
+{
+	openfile->window = window;
+
+	fill_window(1, WINDOWLINES);
+
+	openfile->current = openfile->filetop;
+	openfile->current_x = 0;
+	openfile->placewewant = 0;
+	openfile->edittop = openfile->filetop;
+
+	openfile->totsize = get_totsize(openfile->filetop, openfile->filebot);
+
+	openfile->fmt = ISSET(MAKE_IT_UNIX) ? NIX_FILE : window->filefmt;
+
+	statusline(HUSH, _("File is huge -- reading just the part that is shown"));
+}
+
+/* Write the parts of the windowed file that are above and below the lines
+ * in memory to the given stream -- the former when above is TRUE, the latter
+ * otherwise.  Return TRUE on success. */
+bool write_untouched(windowstruct *window, FILE *stream, bool above)
+{
+	size_t start = (above) ? 0 : window->endbyte;
+	size_t end = (above) ? window->startbyte : window->size;
+
+	return (fwrite(window->map + start, sizeof(char), end - start, stream) == end - start);
+}
+
+/* After the windowed buffer was written in full to the given file, map that
+ * file instead of the original one, so that the lines outside of the window
+ * come from where the edits went.  Return FALSE when the mapping failed. */
+bool rebase_window(windowstruct *window, const char *filename)
+{
+#ifdef HAVE_SYS_MMAN_H
+	ssize_t shift = window_shift(window);
+	struct stat fileinfo;
+	size_t tailsize = window->size - window->endbyte;
+	int fd = open(filename, O_RDONLY);
+	char *map;
+
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat(fd, &fileinfo) != 0 || (size_t)fileinfo.st_size < window->startbyte + tailsize ||
+				(off_t)(size_t)fileinfo.st_size != fileinfo.st_size) {
+		close(fd);
+		return FALSE;
+	}
+
+	map = mmap(NULL, fileinfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	munmap(window->map, window->size);
+
+	/* What lies above the window has not moved; what lies below it has
+	 * moved by as many bytes and lines as the edits have added. */
+	window->map = map;
+	window->size = fileinfo.st_size;
+	window->endbyte = window->size - tailsize;
+	window->bottomline += shift;
+	window->device = fileinfo.st_dev;
+	window->inode = fileinfo.st_ino;
+
+	if (window->lastline > 0)
+		window->lastline += shift;
+
+	/* Keep just the checkpoints that lie above the window. */
+	if (window->checkcount > (window->topline - 1) / CHECKSTEP + 1)
+		window->checkcount = (window->topline - 1) / CHECKSTEP + 1;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/* Begin to follow the growth of the file in the current buffer. */
+void start_following(void)
+{
+	followstruct *follower;
+	struct stat fileinfo;
+	int fd;
+
+	if (openfile->filename[0] == '\0') {
+		statusline(MILD, _("There is no file to follow"));
+		return;
+	}
+
+	if (openfile->modified) {
+		statusline(MILD, _("Cannot follow a modified buffer"));
+		return;
+	}
+
+	fd = open(openfile->filename, O_RDONLY);
+
+	if (fd < 0) {
+		statusline(ALERT, _("Error reading %s: %s"), openfile->filename, strerror(errno));
+		return;
+	}
+
+	/* The file must still be the one whose contents are in the buffer. */
+	if (fstat(fd, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode) ||
+				(openfile->window != NULL && (fileinfo.st_dev != openfile->window->device ||
+										fileinfo.st_ino != openfile->window->inode)) ||
+				(openfile->window == NULL && (openfile->current_stat == NULL ||
+										fileinfo.st_dev != openfile->current_stat->st_dev ||
+										fileinfo.st_ino != openfile->current_stat->st_ino))) {
+		statusline(ALERT, _("File on disk has changed"));
+		close(fd);
+		return;
+	}
+
+	/* What gets appended does not go through the undo stack,
+	 * so a journal would not be able to account for it. */
+	if (openfile->journal != NULL)
+		drop_journal(openfile);
+
+	follower = nmalloc(sizeof(followstruct));
+
+	follower->fd = fd;
+	follower->anchored = FALSE;
+	follower->size = (openfile->window != NULL) ? openfile->window->size :
+												openfile->current_stat->st_size;
+	follower->uncolored = NULL;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	/* Let the kernel say when the file changes, instead of asking repeatedly. */
+	follower->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (follower->watch >= 0 && inotify_add_watch(follower->watch, openfile->filename,
+						IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) < 0) {
+		close(follower->watch);
+		follower->watch = -1;
+	}
+#else
+	follower->watch = -1;
+#endif
+
+	openfile->follower = follower;
+	files_followed++;
+
+	statusbar(_("Following the growth of the file"));
+
+	/* Take in at once whatever was added since the file was read. */
+	take_in_growth(openfile);
+}
+
+/* Stop following the growth of the file in the given buffer. */
+void stop_following(openfilestruct *buffer)
+{
+	followstruct *follower = buffer->follower;
+
+	close(follower->fd);
+	if (follower->watch >= 0)
+		close(follower->watch);
+
+#ifdef ENABLE_COLOR
+	/* Let the lines that were never colored get their info when drawn. */
+	if (follower->uncolored != NULL)
+		discard_multicolorinfo(follower->uncolored);
+#endif
+
+	buffer->follower = NULL;
+	files_followed--;
+
+	free(follower);
+}
+
+/* Determine where in the followed file the last line of the given buffer
+ * begins.  When the file does not end with a line break, this last line
+ * (or the one before an added empty line) holds the incomplete tail.
+ * When the file does not hold that line there, leave it unanchored. */
+void anchor_follower(openfilestruct *buffer)
+{
+	followstruct *follower = buffer->follower;
+	linestruct *last = buffer->filebot;
+	char final = '\n';
+	char *ondisk;
+	size_t length;
+
+	if (buffer->window != NULL)
+		final = buffer->window->map[follower->size - 1];
+	else if (follower->size > 0 && pread(follower->fd, &final, 1, follower->size - 1) < 1)
+		final = '\n';
+
+	if (final != '\n' && last->data[0] == '\0' && last->prev != NULL)
+		last = last->prev;
+
+	length = strlen(last->data);
+
+	/* A carriage return at the very end may still become part of a DOS
+	 * line break, so hold it back until more arrives, as when reading. */
+	follower->linestart = follower->size - (off_t)length -
+						((final == '\r' && !ISSET(NO_CONVERT)) ? 1 : 0);
+	follower->anchored = (follower->linestart >= 0);
+
+	if (!follower->anchored || length == 0)
+		return;
+
+	/* The file must still hold the last line there, or it was rewritten. */
+	if (buffer->window != NULL)
+		ondisk = buffer->window->map + follower->linestart;
+	else {
+		ondisk = charalloc(length);
+		if (pread(follower->fd, ondisk, length, follower->linestart) != (ssize_t)length)
+			follower->anchored = FALSE;
+	}
+
+	/* An encoded NUL in the line is a NUL in the file. */
+	for (size_t index = 0; index < length && follower->anchored; index++)
+		if (ondisk[index] != ((last->data[index] == '\n') ? '\0' : last->data[index]))
+			follower->anchored = FALSE;
+
+	if (buffer->window == NULL)
+		free(ondisk);
+}
+
+/* Map the file of the given window anew, now that it has grown to the given
+ * size, using the given descriptor.  Return FALSE when this fails. */
+bool extend_window(windowstruct *window, int fd, size_t size)
+{
+#ifdef HAVE_SYS_MMAN_H
+	char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	munmap(window->map, window->size);
+
+	window->map = map;
+	window->size = size;
+	window->lastline = 0;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/* Add the given text -- what the followed file holds from the start of the
+ * last line of the given buffer onward -- to the end of that buffer, letting
+ * the first completed line take the place of the incomplete line it grew
+ * out of.  Nothing above that line gets touched. */
+void append_growth(openfilestruct *buffer, const char *text, size_t length)
+{
+	followstruct *follower = buffer->follower;
+	windowstruct *window = buffer->window;
+	linestruct *lastline = buffer->filebot;
+	linestruct *partial = buffer->filebot;
+	linestruct *magic = NULL;
+	linestruct *final;
+	ssize_t was_bottom = lastline->lineno;
+	size_t used, leftover;
+	splitstruct split;
+
+	/* An incomplete last line is followed by an added empty line. */
+	if (follower->linestart < follower->size && !ISSET(NO_NEWLINES) &&
+						partial->prev != NULL) {
+		magic = partial;
+		partial = partial->prev;
+	}
+
+	split.topline = make_new_node(NULL);
+	split.bottomline = split.topline;
+	split.num_lines = 1;
+	split.format = (window != NULL) ? window->format :
+						(buffer->fmt == MAC_FILE) ? 2 : (buffer->fmt == DOS_FILE) ? 1 : 0;
+	split.arena = NULL;
+	split.in_place = FALSE;
+
+	/* The last line gets replaced, and more lines may follow it. */
+	if (buffer->arena != NULL)
+		buffer->arena->pristine = FALSE;
+
+	used = split_into_lines(&split, text, length, FALSE);
+
+	buffer->totsize -= get_totsize(partial, buffer->filebot);
+
+	/* A carriage return at the very end is not shown while it dangles. */
+	leftover = length - used;
+	if (leftover > 0 && text[length - 1] == '\r' && !ISSET(NO_CONVERT))
+		leftover--;
+
+	final = split.bottomline;
+	final->data = encode_data(&split, text + used, leftover);
+
+	if (used == 0) {
+		set_data(partial, final->data);
+		final->data = NULL;
+		delete_node(final);
+		final = partial;
+	} else {
+		linestruct *first = split.topline;
+
+		set_data(partial, first->data);
+		first->data = NULL;
+
+		/* Hang the other completed lines and the tail below it. */
+		partial->next = first->next;
+		first->next->prev = partial;
+		delete_node(first);
+
+		/* When the tail is empty, the added empty line can serve as it. */
+		if (final->data[0] == '\0' && magic != NULL) {
+			final->prev->next = magic;
+			magic->prev = final->prev;
+			delete_node(final);
+			final = magic;
+			magic = NULL;
+		}
+	}
+
+	/* Keep an empty line after an incomplete last line, as when reading. */
+	if (final->data[0] != '\0' && !ISSET(NO_NEWLINES)) {
+		if (magic == NULL)
+			magic = make_text_node(final, "");
+		final->next = magic;
+		magic->prev = final;
+		magic->next = NULL;
+		buffer->filebot = magic;
+	} else {
+		final->next = NULL;
+		buffer->filebot = final;
+	}
+
+	renumber_from(partial);
+	buffer->totsize += get_totsize(partial, buffer->filebot);
+
+	follower->linestart += used;
+
+	if (window != NULL) {
+		window->format |= split.format;
+		window->endbyte = window->size;
+		window->bottomline += buffer->filebot->lineno - was_bottom;
+	}
+
+	/* When the cursor was on the last line, keep it there. */
+	if (buffer->current == lastline && lastline != buffer->filebot) {
+		buffer->current = buffer->filebot;
+		buffer->current_x = 0;
+		buffer->placewewant = 0;
+	}
+
+#ifdef ENABLE_COLOR
+	/* Compute the multiline coloring just for the lines that changed, now
+	 * when the buffer is on display, and otherwise when it gets there. */
+	if (buffer->filetop->multidata != NULL) {
+		if (buffer == openfile)
+			precalc_multicolorinfo_from(partial);
+		else if (follower->uncolored == NULL)
+			follower->uncolored = partial;
+	}
+#endif
+
+	if (buffer == openfile) {
+		focusing = FALSE;
+		refresh_needed = TRUE;
+	}
+}
+
+/* Check whether the followed file of the given buffer has grown, and if so,
+ * add the new lines to the end of the buffer. */
+void take_in_growth(openfilestruct *buffer)
+{
+	followstruct *follower = buffer->follower;
+	windowstruct *window = buffer->window;
+	bool look = (follower->watch < 0 || !follower->anchored);
+	struct stat fileinfo, nameinfo;
+	char *text;
+	off_t start;
+	size_t length, got = 0;
+	ssize_t piece;
+
+	/* Wait until the file has been read in completely. */
+	if (buffer->loader != NULL)
+		return;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (follower->watch >= 0) {
+		char events[4096];
+
+		/* Any event means that the file should be looked at. */
+		while (read(follower->watch, events, sizeof(events)) > 0)
+			look = TRUE;
+	}
+#endif
+
+	if (!look)
+		return;
+
+	if (fstat(follower->fd, &fileinfo) != 0 || fileinfo.st_nlink == 0 ||
+				stat(buffer->filename, &nameinfo) != 0 ||
+				nameinfo.st_dev != fileinfo.st_dev || nameinfo.st_ino != fileinfo.st_ino) {
+		stop_following(buffer);
+		if (buffer == openfile)
+			statusline(ALERT, _("File was moved or deleted -- no longer following it"));
+		return;
+	}
+
+	if (fileinfo.st_size < follower->size) {
+		stop_following(buffer);
+		if (buffer == openfile)
+			statusline(ALERT, _("File was truncated -- no longer following it"));
+		return;
+	}
+
+	if (fileinfo.st_size == follower->size && follower->anchored)
+		return;
+
+	/* For a huge file, extend the mapping; when the end of the file is not
+	 * in memory, the new lines get read in when the user gets there. */
+	if (window != NULL) {
+		if (fileinfo.st_size > follower->size &&
+					!extend_window(window, follower->fd, fileinfo.st_size)) {
+			stop_following(buffer);
+			if (buffer == openfile)
+				statusline(ALERT, _("Error reading %s: %s"), buffer->filename, strerror(errno));
+			return;
+		}
+
+		if (window->endbyte < (size_t)follower->size) {
+			follower->size = fileinfo.st_size;
+			follower->anchored = FALSE;
+			return;
+		}
+	}
+
+	if (!follower->anchored)
+		anchor_follower(buffer);
+
+	if (!follower->anchored) {
+		stop_following(buffer);
+		if (buffer == openfile)
+			statusline(ALERT, _("File on disk has changed"));
+		return;
+	}
+
+	if (fileinfo.st_size == follower->size)
+		return;
+
+	start = follower->linestart;
+	length = fileinfo.st_size - start;
+
+	if (window != NULL) {
+		append_growth(buffer, window->map + start, length);
+		follower->size = fileinfo.st_size;
+	} else {
+		text = charalloc(length);
+
+		while (got < length) {
+			piece = pread(follower->fd, text + got, length - got, start + got);
+			if (piece < 0 && errno == EINTR)
+				continue;
+			if (piece <= 0)
+				break;
+			got += piece;
+		}
+
+		append_growth(buffer, text, got);
+		follower->size = start + got;
+
+		free(text);
+	}
+
+	/* The buffer now matches the file again, also its timestamp. */
+	if (buffer->current_stat != NULL)
+		*buffer->current_stat = fileinfo;
+}
+
+/* Check all followed files for growth. */
+void take_in_all_growth(void)
+{
+#ifdef ENABLE_MULTIBUFFER
+	openfilestruct *buffer = openfile;
+
+	do {
+		if (buffer->follower != NULL)
+			take_in_growth(buffer);
+		buffer = buffer->next;
+	} while (buffer != openfile);
+#else
+	if (openfile->follower != NULL)
+		take_in_growth(openfile);
+#endif
+}
+
+/* Start or stop following the growth of the file in the current buffer. */
+void do_follow(void)
+{
+	if (openfile->follower == NULL)
+		start_following();
+	else {
+		stop_following(openfile);
+		statusbar(_("No longer following the file"));
+	}
+}
+
+/* Let the kernel tell when the file of the given buffer gets changed. */
+void watch_file(openfilestruct *buffer)
+{
+	unwatch_file(buffer);
+
+	buffer->disk_change = SAME_ON_DISK;
+	buffer->reported_change = SAME_ON_DISK;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (buffer->filename[0] == '\0' || buffer->current_stat == NULL)
+		return;
+
+	/* One instance serves all buffers; it gets made when first needed. */
+	if (watcher < 0)
+		watcher = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (watcher >= 0)
+		buffer->watch = inotify_add_watch(watcher, buffer->filename,
+						IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+}
+
+/* Stop watching the file of the given buffer -- except when another buffer
+ * holds the same file, as the kernel gives both buffers the same watch. */
+void unwatch_file(openfilestruct *buffer)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	openfilestruct *other = buffer;
+
+	if (buffer->watch < 0)
+		return;
+
+#ifdef ENABLE_MULTIBUFFER
+	do
+		other = other->next;
+	while (other != buffer && other->watch != buffer->watch);
+#endif
+
+	if (other == buffer)
+		inotify_rm_watch(watcher, buffer->watch);
+
+	buffer->watch = -1;
+#endif
+}
+
+/* Wait at most the given number of milliseconds (or forever, when negative)
+ * for a keystroke or a change of a watched file.  Return TRUE when there is
+ * input for curses to read, and FALSE when there is not. */
+bool await_input(int delay)
+{
+	struct pollfd waiters[2] = {{STANDARD_INPUT, POLLIN, 0}, {watcher, POLLIN, 0}};
+
+	/* When interrupted by a signal, let the caller look at the reason;
+	 * upon any other failure, leave the waiting to curses. */
+	if (poll(waiters, 2, delay) < 0)
+		return (errno != EINTR);
+
+	return (waiters[0].revents != 0);
+}
+
+/* Compare the file of the given buffer with how it was when it was last
+ * read or saved, and take note of what happened to it. */
+void examine_file(openfilestruct *buffer)
+{
+	struct stat *known = buffer->current_stat;
+	struct stat fileinfo;
+
+	/* The growth of a followed file is taken in already, and a file
+	 * that is still being read is looked at when it has been read. */
+	if (buffer->follower != NULL || buffer->loader != NULL || known == NULL)
+		return;
+
+	if (stat(buffer->filename, &fileinfo) != 0)
+		buffer->disk_change = GONE_FROM_DISK;
+	else if (fileinfo.st_dev != known->st_dev || fileinfo.st_ino != known->st_ino)
+		buffer->disk_change = CHANGED_ON_DISK;
+	else if (fileinfo.st_size == known->st_size && fileinfo.st_mtime == known->st_mtime)
+		buffer->disk_change = SAME_ON_DISK;
+	else if (fileinfo.st_size > known->st_size && !buffer->modified &&
+						buffer->disk_change != CHANGED_ON_DISK)
+		buffer->disk_change = GROWN_ON_DISK;
+	else
+		buffer->disk_change = CHANGED_ON_DISK;
+}
+
+/* Read what the kernel says about the watched files, and for each buffer
+ * with a watched file, see what happened to it.  Return TRUE when the file
+ * of the current buffer had a change that was not yet reported. */
+bool spot_changes(void)
+{
+#ifdef ENABLE_MULTIBUFFER
+	openfilestruct *buffer = openfile;
+#endif
+	char events[4096];
+	bool something = FALSE;
+
+	/* The details of the events do not matter: just look at the files. */
+	while (read(watcher, events, sizeof(events)) > 0)
+		something = TRUE;
+
+	if (!something)
+		return FALSE;
+
+#ifdef ENABLE_MULTIBUFFER
+	do {
+		if (buffer->watch >= 0)
+			examine_file(buffer);
+		buffer = buffer->next;
+	} while (buffer != openfile);
+#else
+	if (openfile->watch >= 0)
+		examine_file(openfile);
+#endif
+
+	return (openfile->disk_change != openfile->reported_change);
+}
+
+/* Append to the current buffer what was appended to its file on disk. */
+void take_in_additions(void)
+{
+	ssize_t was_bottom = openfile->filebot->lineno;
+
+	/* Following the file for just a moment takes in its growth. */
+	start_following();
+
+	if (openfile->follower == NULL) {
+		openfile->disk_change = CHANGED_ON_DISK;
+		openfile->reported_change = CHANGED_ON_DISK;
+		return;
+	}
+
+	stop_following(openfile);
+
+	openfile->disk_change = SAME_ON_DISK;
+	openfile->reported_change = SAME_ON_DISK;
+
+	/* Of a huge file, the additions may get read only when needed. */
+	if (openfile->window != NULL)
+		statusline(HUSH, _("Took in the additions"));
+	else
+		statusline(HUSH, P_("Added %zd line", "Added %zd lines",
+						openfile->filebot->lineno - was_bottom),
+						openfile->filebot->lineno - was_bottom);
+}
+
+/* Tell the user about what happened to the file of the current buffer on
+ * disk, and when the file merely grew, offer to take in what was added. */
+void report_change_on_disk(void)
+{
+	openfile->reported_change = openfile->disk_change;
+
+	if (openfile->disk_change == GONE_FROM_DISK)
+		statusline(ALERT, _("File was moved or deleted"));
+	else if (openfile->disk_change == CHANGED_ON_DISK)
+		statusline(ALERT, _("File on disk has changed"));
+	else if (openfile->disk_change == GROWN_ON_DISK) {
+		if (do_yesno_prompt(FALSE, _("File on disk has grown; "
+								"take in the additions? ")) == 1)
+			take_in_additions();
+		else
+			wipe_statusbar();
+	}
+}
+#endif /* !NANO_TINY */
+
+/* Report on the status bar how many lines were read, and in what format. */
+void report_lines_read(size_t num_lines, int format)
 {
-	unsunder(buf, buf_len);
-	buf[buf_len] = '\0';
-
-	return copy_of(buf);
+#ifndef NANO_TINY
+	if (format == 3) {
+		/* TRANSLATORS: Keep the next four messages at most 78 characters. */
+		statusline(HUSH, P_("Read %zu line (Converted from DOS and Mac format)",
+						"Read %zu lines (Converted from DOS and Mac format)",
+						num_lines), num_lines);
+	} else if (format == 2) {
+		statusline(HUSH, P_("Read %zu line (Converted from Mac format)",
+						"Read %zu lines (Converted from Mac format)",
+						num_lines), num_lines);
+	} else if (format == 1) {
+		statusline(HUSH, P_("Read %zu line (Converted from DOS format)",
+						"Read %zu lines (Converted from DOS format)",
+						num_lines), num_lines);
+	} else
+#endif
+		statusline(HUSH, P_("Read %zu line", "Read %zu lines",
+						num_lines), num_lines);
 }
 
 /* Read the given open file f into the current buffer.  filename should be
@@ -688,35 +4300,26 @@ void read_file(FILE *f, int fd, const char *filename, bool undoable)
 		/* The line number where we start the insertion. */
 	size_t was_leftedge = 0;
 		/* The leftedge where we start the insertion. */
-	size_t num_lines = 0;
+	splitstruct split;
+		/* The lines that were read so far, and the format of the file. */
+	size_t num_lines;
 		/* The number of lines in the file. */
-	size_t len = 0;
-		/* The length of the current line of the file. */
-	char input = '\0';
-		/* The current input character. */
-	char *buf;
-		/* The buffer in which we assemble each line of the file. */
-	size_t bufx = MAX_BUF_SIZE;
-		/* The allocated size of the line buffer; increased as needed. */
-	linestruct *topline;
-		/* The top of the new buffer where we store the read file. */
-	linestruct *bottomline;
-		/* The bottom of the new buffer. */
-	int input_int;
-		/* The current value we read from the file, whether an input
-		 * character or EOF. */
 	int errornumber;
 		/* The error code, in case an error occurred during reading. */
 	bool writable = TRUE;
 		/* Whether the file is writable (in case we care). */
 #ifndef NANO_TINY
-	int format = 0;
+	int format;
 		/* 0 = *nix, 1 = DOS, 2 = Mac, 3 = both DOS and Mac. */
-#endif
-
-	buf = charalloc(bufx);
+	loaderstruct *loader = NULL;
+		/* The background reader of the rest of a big file, if any. */
+	windowstruct *window = NULL;
+		/* The window onto a huge file, if any. */
+	bool fetched = FALSE;
+		/* Whether a helper already read the file. */
+	bool gzipped = FALSE;
+		/* Whether the file needs to be decompressed while reading. */
 
-#ifndef NANO_TINY
 	if (undoable)
 		add_undo(INSERT, NULL);
 
@@ -724,100 +4327,61 @@ void read_file(FILE *f, int fd, const char *filename, bool undoable)
 		was_leftedge = leftedge_for(xplustabs(), openfile->current);
 #endif
 
+#ifndef NANO_TINY
+	/* The lines of a file that is opened go into an arena of their own,
+	 * and lines that are inserted go into the arena of the buffer, if any. */
+	split.arena = undoable ? openfile->arena : make_arena();
+	split.format = 0;
+	split.in_place = FALSE;
+#endif
+
 	/* Create an empty buffer. */
-	topline = make_new_node(NULL);
-	bottomline = topline;
+	split.topline = make_split_node(&split, NULL);
+	split.bottomline = split.topline;
+	split.num_lines = 0;
 
 #ifndef NANO_TINY
 	block_sigwinch(TRUE);
 #endif
 
-	/* Lock the file before starting to read it, to avoid the overhead
-	 * of locking it for each single byte that we read from it. */
-	flockfile(f);
-
 	control_C_was_pressed = FALSE;
 
-	/* Read the entire file into the new buffer. */
-	while ((input_int = getc_unlocked(f)) != EOF) {
-
-		if (control_C_was_pressed) {
-			statusline(ALERT, _("Interrupted"));
-			break;
-		}
-
-		input = (char)input_int;
-
-		/* If it's a *nix file ("\n") or a DOS file ("\r\n"), and file
-		 * conversion isn't disabled, handle it! */
-		if (input == '\n') {
 #ifndef NANO_TINY
-			/* If it's a DOS file or a DOS/Mac file ('\r' before '\n' on
-			 * the first line if we think it's a *nix file, or on any
-			 * line otherwise), and file conversion isn't disabled,
-			 * handle it! */
-			if ((num_lines == 0 || format != 0) && !ISSET(NO_CONVERT) &&
-						len > 0 && buf[len - 1] == '\r') {
-				if (format == 0 || format == 2)
-					format++;
-			}
-		/* If it's a Mac file ('\r' without '\n' on the first line if we
-		 * think it's a *nix file, or on any line otherwise), and file
-		 * conversion isn't disabled, handle it! */
-		} else if ((num_lines == 0 || format != 0) && !ISSET(NO_CONVERT) &&
-						len > 0 && buf[len - 1] == '\r') {
-			/* If we currently think the file is a *nix file, set format
-			 * to Mac.  If we currently think the file is a DOS file,
-			 * set format to both DOS and Mac. */
-			if (format == 0 || format == 1)
-				format += 2;
+#ifdef USE_ZLIB
+	/* A gzipped file can be decompressed only in one go, from its start. */
+	gzipped = (fd > 0 && is_gzipped(fd));
 #endif
-		} else {
-			/* Store the character. */
-			buf[len] = input;
-
-			/* Keep track of the total length of the line.  It might have
-			 * nulls in it, so we can't just use strlen() later. */
-			len++;
-
-			/* If needed, increase the buffer size, MAX_BUF_SIZE characters at
-			 * a time.  Don't bother decreasing it; it is freed at the end. */
-			if (len == bufx) {
-				bufx += MAX_BUF_SIZE;
-				buf = charealloc(buf, bufx);
-			}
-			continue;
-		}
 
-#ifndef NANO_TINY
-		/* If it's a DOS or Mac line, strip the '\r' from it. */
-		if (len > 0 && buf[len - 1] == '\r' && !ISSET(NO_CONVERT))
-			buf[--len] = '\0';
+	/* When opening many files, a helper may have read this one already. */
+	if (fd > 0 && !undoable && !gzipped && prefetch != NULL)
+		fetched = take_prefetched(filename, f, &split);
+
+	/* For a huge file, read only the part that is needed; when
+	 * opening a big file, read just its start, and the rest later. */
+	if (fd > 0 && !undoable && !gzipped && !fetched)
+		window = open_window(f);
+	if (fd > 0 && !undoable && !gzipped && !fetched && window == NULL)
+		loader = begin_loading(f, &split);
+
+	/* Data that comes through a pipe is shown as it arrives. */
+	if (fd == 0 && !undoable && !isatty(STANDARD_INPUT))
+		loader = begin_streaming(f, &split);
+
+	if (fetched || loader != NULL || window != NULL)
+		errornumber = 0;
+#ifdef USE_ZLIB
+	else if (gzipped)
+		errornumber = inflate_into_lines(f, &split);
 #endif
-
-		/* Store the data and make a new line. */
-		bottomline->data = encode_data(buf, len);
-		bottomline->next = make_new_node(bottomline);
-		bottomline = bottomline->next;
-		num_lines++;
-
-		/* Reset the length in preparation for the next line. */
-		len = 0;
-
-#ifndef NANO_TINY
-		/* If it happens to be a Mac line, store the character after the \r
-		 * as the first character of the next line. */
-		if (input != '\n')
-			buf[len++] = input;
+	else
 #endif
-	}
-
-	errornumber = errno;
-
-	/* We are done with the file, unlock it. */
-	funlockfile(f);
+	/* Read the entire file into the new buffer. */
+	errornumber = slurp_into_lines(f, &split);
 
+	num_lines = split.num_lines;
 #ifndef NANO_TINY
+	format = split.format;
+
 	block_sigwinch(FALSE);
 #endif
 
@@ -830,7 +4394,7 @@ void read_file(FILE *f, int fd, const char *filename, bool undoable)
 	}
 
 	/* If there was a real error during the reading, let the user know. */
-	if (ferror(f) && errornumber != EINTR && errornumber != 0)
+	if (errornumber != 0)
 		statusline(ALERT, strerror(errornumber));
 	fclose(f);
 
@@ -839,70 +4403,56 @@ void read_file(FILE *f, int fd, const char *filename, bool undoable)
 		writable = (ISSET(VIEW_MODE) || access(filename, W_OK) == 0);
 	}
 
-	/* If the file ended with newline, or it was entirely empty, make the
-	 * last line blank.  Otherwise, put the last read data in. */
-	if (len == 0)
-		bottomline->data = copy_of("");
-	else {
-		bool mac_line_needs_newline = FALSE;
-
 #ifndef NANO_TINY
-		/* If the final character is '\r', and file conversion isn't disabled,
-		 * set format to Mac if we currently think the file is a *nix file, or
-		 * to DOS-and-Mac if we currently think it is a DOS file. */
-		if (buf[len - 1] == '\r' && !ISSET(NO_CONVERT)) {
-			if (format < 2)
-				format += 2;
-
-			/* Strip the carriage return. */
-			buf[--len] = '\0';
-
-			/* Indicate we need to put a blank line in after this one. */
-			mac_line_needs_newline = TRUE;
-		}
-#endif
-		/* Store the data of the final line. */
-		bottomline->data = encode_data(buf, len);
-		num_lines++;
-
-		if (mac_line_needs_newline) {
-			bottomline->next = make_new_node(bottomline);
-			bottomline = bottomline->next;
-			bottomline->data = copy_of("");
-		}
+	/* Let the pieces of the lines be recognized as such. */
+	if (split.arena != NULL)
+		adopt_blocks(split.arena, &split.arena->fresh);
+
+	if (window != NULL) {
+		free_arena(split.arena);
+		start_window(window);
+		if (!writable)
+			statusline(ALERT, _("File '%s' is unwritable"), filename);
+		return;
 	}
-
-	free(buf);
+#endif
 
 	/* Insert the just read buffer into the current one. */
-	ingraft_buffer(topline);
+	ingraft_buffer(split.topline);
 
 	/* Set the desired x position at the end of what was inserted. */
 	openfile->placewewant = xplustabs();
 
+#ifndef NANO_TINY
+	/* A buffer that was read from a gzipped file gets saved compressed. */
+	if (!undoable) {
+		openfile->gzipped = gzipped;
+		openfile->arena = split.arena;
+	}
+
+	/* Let the rest of a big file arrive while the user looks around. */
+	if (loader != NULL) {
+		loader->writable = writable;
+		statusbar(_("Reading..."));
+		start_loading(loader);
+		return;
+	}
+#endif
+
 	if (!writable)
 		statusline(ALERT, _("File '%s' is unwritable"), filename);
+	else {
 #ifndef NANO_TINY
-	else if (format == 3) {
-		/* TRANSLATORS: Keep the next four messages at most 78 characters. */
-		statusline(HUSH, P_("Read %zu line (Converted from DOS and Mac format)",
-						"Read %zu lines (Converted from DOS and Mac format)",
-						num_lines), num_lines);
-	} else if (format == 2) {
-		openfile->fmt = MAC_FILE;
-		statusline(HUSH, P_("Read %zu line (Converted from Mac format)",
-						"Read %zu lines (Converted from Mac format)",
-						num_lines), num_lines);
-	} else if (format == 1) {
-		openfile->fmt = DOS_FILE;
-		statusline(HUSH, P_("Read %zu line (Converted from DOS format)",
-						"Read %zu lines (Converted from DOS format)",
-						num_lines), num_lines);
-	}
+		if (format == 2)
+			openfile->fmt = MAC_FILE;
+		else if (format == 1)
+			openfile->fmt = DOS_FILE;
+
+		report_lines_read(num_lines, format);
+#else
+		report_lines_read(num_lines, 0);
 #endif
-	else
-		statusline(HUSH, P_("Read %zu line", "Read %zu lines",
-						num_lines), num_lines);
+	}
 
 	/* If we inserted less than a screenful, don't center the cursor. */
 	if (undoable && less_than_a_screenful(was_lineno, was_leftedge))
@@ -1463,6 +5013,45 @@ void init_backup_dir(void)
 }
 #endif /* !NANO_TINY */
 
+#ifndef NANO_TINY
+/* Let the kernel copy the rest of the regular file inn to out, without the
+ * data passing through user space: by letting out share the data blocks of
+ * inn when out is empty and the filesystem can do it, or else by having the
+ * data copied in-kernel.  Return TRUE when everything was copied, and FALSE
+ * when (the rest of) the copying has to be done the ordinary way. */
+bool offload_copy(FILE *inn, FILE *out)
+{
+	int fd_in = fileno(inn), fd_out = fileno(out);
+	struct stat fileinfo;
+
+	/* Copying in-kernel bypasses the buffer of out, and cannot append. */
+	if (fflush(out) == EOF || fstat(fd_in, &fileinfo) != 0 ||
+				!S_ISREG(fileinfo.st_mode) || (fcntl(fd_out, F_GETFL) & O_APPEND))
+		return FALSE;
+
+#ifdef FICLONE
+	if (lseek(fd_in, 0, SEEK_CUR) == 0 && fstat(fd_out, &fileinfo) == 0 &&
+				fileinfo.st_size == 0 && ioctl(fd_out, FICLONE, fd_in) == 0) {
+		lseek(fd_out, 0, SEEK_END);
+		return TRUE;
+	}
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	while (TRUE) {
+		ssize_t copied = copy_file_range(fd_in, NULL, fd_out, NULL, 64 * LUMPSIZE, 0);
+
+		/* On failure, the ordinary copying continues where this stopped. */
+		if (copied < 0)
+			return FALSE;
+		else if (copied == 0)
+			return TRUE;
+	}
+#else
+	return FALSE;
+#endif
+}
+#endif /* !NANO_TINY */
+
 /* Read from inn, write to out.  We assume inn is opened for reading,
  * and out for writing.  We return 0 on success, -1 on read error, or -2
  * on write error.  inn is always closed by this function, out is closed
@@ -1470,21 +5059,30 @@ void init_backup_dir(void)
 int copy_file(FILE *inn, FILE *out, bool close_out)
 {
 	int retval = 0;
-	char buf[BUFSIZ];
+	char *buf;
 	size_t charsread;
 	int (*flush_out_fnc)(FILE *) = (close_out) ? fclose : fflush;
 
-	do {
-		charsread = fread(buf, sizeof(char), BUFSIZ, inn);
-		if (charsread == 0 && ferror(inn)) {
-			retval = -1;
-			break;
-		}
-		if (fwrite(buf, sizeof(char), charsread, out) < charsread) {
-			retval = -2;
-			break;
-		}
-	} while (charsread > 0);
+#ifndef NANO_TINY
+	if (!offload_copy(inn, out))
+#endif
+	{
+		buf = charalloc(LUMPSIZE);
+
+		do {
+			charsread = fread(buf, sizeof(char), LUMPSIZE, inn);
+			if (charsread == 0 && ferror(inn)) {
+				retval = -1;
+				break;
+			}
+			if (fwrite(buf, sizeof(char), charsread, out) < charsread) {
+				retval = -2;
+				break;
+			}
+		} while (charsread > 0);
+
+		free(buf);
+	}
 
 	if (fclose(inn) == EOF)
 		retval = -1;
@@ -1494,6 +5092,183 @@ int copy_file(FILE *inn, FILE *out, bool close_out)
 	return retval;
 }
 
+/* Write the given pieces to the given file descriptor, continuing after
+ * a partial write.  Return TRUE on success, and FALSE otherwise. */
+bool write_pieces(int fd, struct iovec *pieces, int count)
+{
+	while (count > 0) {
+		ssize_t written = writev(fd, pieces, count);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+
+		/* Skip the pieces that went out whole, and trim a partial one. */
+		while (count > 0 && (size_t)written >= pieces->iov_len) {
+			written -= pieces->iov_len;
+			pieces++;
+			count--;
+		}
+
+		if (count > 0) {
+			pieces->iov_base = (char *)pieces->iov_base + written;
+			pieces->iov_len -= written;
+		}
+	}
+
+	return TRUE;
+}
+
+#ifdef USE_ZLIB
+/* Compress the given pieces into the given gzip stream.  Return TRUE on
+ * success, and FALSE otherwise. */
+bool write_packed(gzFile packer, struct iovec *pieces, int count)
+{
+	for (int index = 0; index < count; index++)
+		if (pieces[index].iov_len > 0 && gzwrite(packer,
+					pieces[index].iov_base, pieces[index].iov_len) == 0)
+			return FALSE;
+
+	return TRUE;
+}
+#endif
+
+/* Write the lines from the given one to the end of the buffer to the given
+ * stream, many lines per system call, ending each of them in the format of
+ * the buffer -- except the last one, unless more_follows is TRUE.  When
+ * gzipping is TRUE, compress the lines in gzip format.  Return the number
+ * of lines written (not counting an empty last line), or -1 when an error
+ * occurred. */
+ssize_t write_lines(FILE *stream, linestruct *line, bool more_follows,
+		bool gzipping)
+{
+	struct iovec pieces[2 * WRITEBATCH];
+	size_t lengths[WRITEBATCH];
+	const char *ending = "\n";
+	ssize_t lineswritten = 0;
+	linestruct *first;
+	bool okay = TRUE;
+	int count, index;
+#ifdef USE_ZLIB
+	gzFile packer = NULL;
+#endif
+
+#ifndef NANO_TINY
+	if (openfile->fmt == DOS_FILE)
+		ending = "\r\n";
+	else if (openfile->fmt == MAC_FILE)
+		ending = "\r";
+#endif
+
+	/* What went through the stream must precede what goes around it. */
+	if (fflush(stream) != 0)
+		return -1;
+
+#ifdef USE_ZLIB
+	/* Let zlib compress into a copy of the descriptor, to close it apart. */
+	if (gzipping) {
+		int fd = dup(fileno(stream));
+
+		if (fd < 0 || (packer = gzdopen(fd, "wb")) == NULL) {
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+	}
+#endif
+
+	while (line != NULL && okay) {
+		first = line;
+		count = 0;
+
+		for (index = 0; line != NULL && index < WRITEBATCH; index++) {
+			lengths[index] = strlen(line->data);
+
+			pieces[count].iov_base = line->data;
+			pieces[count++].iov_len = lengths[index];
+
+			/* After the last line of the file, write no line ending.  If that
+			 * line is empty, zero bytes are written, so don't count it. */
+			if (line != openfile->filebot || more_follows) {
+				pieces[count].iov_base = (char *)ending;
+				pieces[count++].iov_len = strlen(ending);
+			} else if (lengths[index] == 0)
+				lineswritten--;
+
+			line = line->next;
+			lineswritten++;
+		}
+
+		/* Decode LFs as the NULs that they are, before writing to disk --
+		 * only after measuring all lines, as some may share their text. */
+		for (linestruct *item = first; item != line; item = item->next)
+			sunder(item->data);
+
+#ifdef USE_ZLIB
+		if (packer != NULL)
+			okay = write_packed(packer, pieces, count);
+		else
+#endif
+		okay = write_pieces(fileno(stream), pieces, count);
+
+		/* Re-encode any embedded NULs as LFs. */
+		for (index = 0; first != line; first = first->next)
+			unsunder(first->data, lengths[index++]);
+	}
+
+#ifdef USE_ZLIB
+	/* Flush the rest of the compressed data, and the gzip trailer. */
+	if (packer != NULL && gzclose(packer) != Z_OK)
+		okay = FALSE;
+#endif
+
+	return (okay ? lineswritten : -1);
+}
+
+#ifndef NANO_TINY
+/* Create an empty file beside the given one (at the end of any symlink),
+ * with the same owner and permissions, to write the new contents to before
+ * it gets renamed over the original.  Return its descriptor, or -1 when it
+ * cannot be made.  Set stagename to the name of the new file, and targetname
+ * to the name of the file that it is meant to replace. */
+int make_stagefile(const char *filename, const struct stat *st,
+		char **stagename, char **targetname)
+{
+	char *target = realpath(filename, NULL);
+	int fd;
+
+	if (target == NULL)
+		return -1;
+
+	*stagename = charalloc(strlen(target) + 8);
+	sprintf(*stagename, "%s.XXXXXX", target);
+
+	fd = mkstemp(*stagename);
+
+	if (fd != -1 && ((geteuid() == NANO_ROOT_UID &&
+					fchown(fd, st->st_uid, st->st_gid) == -1) ||
+					fchmod(fd, st->st_mode) == -1)) {
+		int error = errno;
+
+		close(fd);
+		unlink(*stagename);
+		errno = error;
+		fd = -1;
+	}
+
+	if (fd == -1) {
+		free(*stagename);
+		*stagename = NULL;
+		free(target);
+	} else
+		*targetname = target;
+
+	return fd;
+}
+#endif
+
 /* Write the current buffer to disk.  If stream isn't NULL, we write to a
  * temporary file that is already open.  If tmp is TRUE (when spell checking
  * or emergency dumping, for example), we set the umask to disallow anyone else
@@ -1510,7 +5285,17 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 #ifndef NANO_TINY
 	bool isactualfile = FALSE;
 		/* Becomes TRUE when the file is non-temporary and exists. */
+	windowstruct *window = openfile->window;
+		/* The window onto the file, when the buffer holds just a part of it. */
+	char *stagename = NULL;
+		/* The name of the file we write to first, when not writing in place. */
+	char *targetname = NULL;
+		/* The name of the file that the above file will replace. */
 #endif
+	bool more_follows = FALSE;
+		/* Whether text from the file follows after the last line in memory. */
+	bool gzipping = FALSE;
+		/* Whether the text gets compressed on its way to disk. */
 	struct stat st;
 		/* The status fields filled in by stat(). */
 	char *realname;
@@ -1519,9 +5304,7 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 		/* The actual file, corresponding to realname, we are writing to. */
 	char *tempname = NULL;
 		/* The name of the temporary file we write to on prepend. */
-	linestruct *line = openfile->filetop;
-		/* An iterator for moving through the lines of the buffer. */
-	size_t lineswritten = 0;
+	ssize_t lineswritten;
 		/* The number of lines written, for feedback on the status bar. */
 	bool retval = FALSE;
 		/* The return value, to become TRUE when writing has succeeded. */
@@ -1545,6 +5328,19 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 		goto cleanup_and_exit;
 
 #ifndef NANO_TINY
+	/* The untouched parts of a huge file get copied as they are, so the
+	 * lines in memory must be written with the line endings of the file. */
+	if (window != NULL && openfile->fmt != window->filefmt) {
+		statusline(ALERT, _("Cannot change the format of a huge file"));
+		goto cleanup_and_exit;
+	}
+
+	if (window != NULL)
+		more_follows = (window->endbyte < window->size);
+
+	/* A buffer that came from a gzipped file is saved in the same way. */
+	gzipping = (openfile->gzipped && method == OVERWRITE && !tmp);
+
 	/* Check whether the file (at the end of the symlink) exists. */
 	if (!tmp)
 		isactualfile = (stat(realname, &st) != -1);
@@ -1639,10 +5435,11 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 			goto cleanup_and_exit;
 		}
 
+		/* A new file needs no appending, which allows copying in-kernel. */
 		if (ISSET(INSECURE_BACKUP))
 			backup_cflags = O_WRONLY | O_CREAT | O_APPEND;
 		else
-			backup_cflags = O_WRONLY | O_CREAT | O_EXCL | O_APPEND;
+			backup_cflags = O_WRONLY | O_CREAT | O_EXCL;
 
 		backup_fd = open(backupname, backup_cflags,
 				S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
@@ -1755,10 +5552,40 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 #endif /* !NANO_TINY */
 
 	if (stream == NULL) {
-		int fd;
+		int fd = -1;
 #ifndef NANO_TINY
+		bool mapped = (window != NULL && isactualfile &&
+					st.st_dev == window->device && st.st_ino == window->inode);
+		bool renamable = (isactualfile && st.st_nlink == 1 &&
+					(st.st_uid == geteuid() || geteuid() == NANO_ROOT_UID));
+
+		/* The mapped file of a huge buffer is read while writing, so it may
+		 * not be truncated: it can only be replaced by a new file.  But when
+		 * it has other links, or (when not root) belongs to someone else,
+		 * the new file would not take its place in those links or would get
+		 * another owner, so then refuse to overwrite it. */
+		if (mapped && method != APPEND && !renamable) {
+			statusline(ALERT, _("Cannot overwrite %s: it has other links "
+								"or another owner"), realname);
+			if (tmp)
+				umask(original_umask);
+			if (tempname != NULL)
+				unlink(tempname);
+			goto cleanup_and_exit;
+		}
+
 		block_sigwinch(TRUE);
 		install_handler_for_Ctrl_C();
+
+		/* Such a mapped file, and a file that is saved atomically (unless the
+		 * renaming would break links or change its owner), get written to a
+		 * file beside it that then gets renamed over it.  Appending can always
+		 * happen in place, as it leaves the existing contents alone. */
+		if (method != APPEND && (mapped || (ISSET(ATOMIC_SAVE) && isactualfile &&
+					S_ISREG(st.st_mode) && renamable)))
+			fd = make_stagefile(realname, &st, &stagename, &targetname);
+
+		if (fd == -1 && (!mapped || method == APPEND))
 #endif
 		/* Now open the file in place.  Use O_EXCL if tmp is TRUE.  This
 		 * is copied from joe, because wiggy says so *shrug*. */
@@ -1799,57 +5626,38 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 	if (!tmp)
 		statusbar(_("Writing..."));
 
-	while (line != NULL) {
-		size_t data_len = strlen(line->data), size;
-
-		/* Decode LFs as the NULs that they are, before writing to disk. */
-		sunder(line->data);
+#ifndef NANO_TINY
+	/* Of a huge file, first copy the part above the lines in memory. */
+	if (window != NULL && !write_untouched(window, f, TRUE)) {
+		statusline(ALERT, _("Error writing %s: %s"), realname,
+					strerror(errno));
+		fclose(f);
+		goto cleanup_and_exit;
+	}
+#endif
 
-		size = fwrite(line->data, sizeof(char), data_len, f);
+	lineswritten = write_lines(f, openfile->filetop, more_follows, gzipping);
 
-		/* Re-encode any embedded NULs as LFs. */
-		unsunder(line->data, data_len);
+	if (lineswritten < 0) {
+		statusline(ALERT, _("Error writing %s: %s"), realname,
+					strerror(errno));
+		fclose(f);
+		goto cleanup_and_exit;
+	}
 
-		if (size < data_len) {
+#ifndef NANO_TINY
+	/* Of a huge file, then copy the part below the lines in memory. */
+	if (window != NULL) {
+		if (!write_untouched(window, f, FALSE)) {
 			statusline(ALERT, _("Error writing %s: %s"), realname,
 						strerror(errno));
 			fclose(f);
 			goto cleanup_and_exit;
 		}
 
-		/* If we're on the last line of the file, don't write a newline
-		 * character after it.  If the last line of the file is blank,
-		 * this means that zero bytes are written, in which case we
-		 * don't count the last line in the total lines written. */
-		if (line == openfile->filebot) {
-			if (line->data[0] == '\0')
-				lineswritten--;
-		} else {
-#ifndef NANO_TINY
-			if (openfile->fmt == DOS_FILE || openfile->fmt == MAC_FILE) {
-				if (putc('\r', f) == EOF) {
-					statusline(ALERT, _("Error writing %s: %s"), realname,
-								strerror(errno));
-					fclose(f);
-					goto cleanup_and_exit;
-				}
-			}
-
-			if (openfile->fmt != MAC_FILE)
-#endif
-				if (putc('\n', f) == EOF) {
-					statusline(ALERT, _("Error writing %s: %s"), realname,
-								strerror(errno));
-					fclose(f);
-					goto cleanup_and_exit;
-				}
-		}
-
-		line = line->next;
-		lineswritten++;
+		lineswritten = windowed_textlines(window);
 	}
 
-#ifndef NANO_TINY
 	/* When prepending, append the temporary file to what we wrote above. */
 	if (method == PREPEND) {
 		int fd_src;
@@ -1870,14 +5678,23 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 			goto cleanup_and_exit;
 		}
 
-		if (copy_file(source, f, TRUE) != 0) {
+		if (copy_file(source, f, FALSE) != 0) {
 			statusline(ALERT, _("Error writing %s: %s"), realname,
 						strerror(errno));
+			fclose(f);
 			goto cleanup_and_exit;
 		}
 
 		unlink(tempname);
-	} else
+	}
+
+	/* Make sure the new contents are on disk before they replace the old. */
+	if (stagename != NULL && (fflush(f) != 0 || fdatasync(fileno(f)) != 0)) {
+		statusline(ALERT, _("Error writing %s: %s"), realname,
+						strerror(errno));
+		fclose(f);
+		goto cleanup_and_exit;
+	}
 #endif
 	if (fclose(f) != 0) {
 		statusline(ALERT, _("Error writing %s: %s"), realname,
@@ -1885,6 +5702,15 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 		goto cleanup_and_exit;
 	}
 
+#ifndef NANO_TINY
+	/* Put the fully written new file in place of the original. */
+	if (stagename != NULL && rename(stagename, targetname) == -1) {
+		statusline(ALERT, _("Error writing %s: %s"), realname,
+						strerror(errno));
+		goto cleanup_and_exit;
+	}
+#endif
+
 	/* When having written an entire buffer, update some administrivia. */
 	if (fullbuffer && method == OVERWRITE && !tmp) {
 		/* If the filename was changed, check if this means a new syntax. */
@@ -1924,17 +5750,39 @@ bool write_file(const char *name, FILE *stream, bool tmp,
 		/* Record at which point in the undo stack the file was saved. */
 		openfile->last_saved = openfile->current_undo;
 		openfile->last_action = OTHER;
+
+		/* The saved edits need no journal any more; start a fresh one. */
+		start_journal(openfile);
+
+		/* Watch the file under its possibly new name, or its new inode. */
+		watch_file(openfile);
+
+		/* From now on, read the lines outside of the window from the written
+		 * file; when that fails, the edited lines must stay in memory. */
+		if (window == NULL || rebase_window(window, realname))
 #endif
 		openfile->modified = FALSE;
 		titlebar(NULL);
 	}
 
+#ifndef NANO_TINY
+	/* When the length of a huge file is not yet known, do not go count it. */
+	if (!tmp && window != NULL && lineswritten == 0)
+		statusline(HUSH, _("Wrote the whole file"));
+	else
+#endif
 	if (!tmp)
 		statusline(HUSH, P_("Wrote %zu line", "Wrote %zu lines",
-								lineswritten), lineswritten);
+								lineswritten), (size_t)lineswritten);
 	retval = TRUE;
 
   cleanup_and_exit:
+#ifndef NANO_TINY
+	if (stagename != NULL && !retval)
+		unlink(stagename);
+	free(stagename);
+	free(targetname);
+#endif
 	free(realname);
 	free(tempname);
 
@@ -1949,6 +5797,7 @@ bool write_marked_file(const char *name, FILE *stream, bool tmp,
 {
 	bool retval;
 	bool added_magicline = FALSE;
+	windowstruct *window = openfile->window;
 	linestruct *top, *bot;
 	size_t top_x, bot_x;
 
@@ -1957,6 +5806,9 @@ bool write_marked_file(const char *name, FILE *stream, bool tmp,
 				(const linestruct **)&bot, &bot_x, NULL);
 	partition_buffer(top, top_x, bot, bot_x);
 
+	/* Even when it is part of a huge file, treat the partition as whole. */
+	openfile->window = NULL;
+
 	/* If we are using a magic line, and the last line of the partition
 	 * isn't blank, then add a newline at the end of the buffer. */
 	if (!ISSET(NO_NEWLINES) && openfile->filebot->data[0] != '\0') {
@@ -1969,6 +5821,8 @@ bool write_marked_file(const char *name, FILE *stream, bool tmp,
 	if (added_magicline)
 		remove_magicline();
 
+	openfile->window = window;
+
 	/* Unpartition the buffer so that it contains all the text again. */
 	unpartition_buffer();
 
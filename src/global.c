@@ -47,6 +47,19 @@ bool as_an_at = TRUE;
 bool control_C_was_pressed = FALSE;
 		/* Whether Ctrl+C was pressed (when a keyboard interrupt is enabled). */
 
+#ifndef NANO_TINY
+int files_loading = 0;
+		/* The number of files that are still being read in the background. */
+int files_followed = 0;
+		/* The number of files whose growth is being followed. */
+int watcher = -1;
+		/* The inotify instance that watches the files of the buffers. */
+prefetchstruct *prefetch = NULL;
+		/* The helpers that read ahead the files named on the command line. */
+bool replaying_journal = FALSE;
+		/* Whether the edits from a journal are being carried out. */
+#endif
+
 bool started_curses = FALSE;
 
 bool suppress_cursorpos = FALSE;
@@ -121,6 +134,10 @@ int margin = 0;
 ssize_t stripe_column = 0;
 		/* The column at which a vertical bar will be drawn. */
 #endif
+#if defined(ENABLE_MULTIBUFFER) && !defined(NANO_TINY)
+ssize_t compress_after = 0;
+		/* After how many idle seconds a buffer gets packed; zero for never. */
+#endif
 
 linestruct *cutbuffer = NULL;
 		/* The buffer where we store cut text. */
@@ -174,6 +191,8 @@ const char *locking_prefix = ".";
 		/* Prefix of how to store the vim-style lock file. */
 const char *locking_suffix = ".swp";
 		/* Suffix of the vim-style lock file. */
+const char *journal_suffix = ".journal";
+		/* Suffix of the journal of unsaved edits. */
 #endif
 #ifdef ENABLE_OPERATINGDIR
 char *operating_dir = NULL;
@@ -577,6 +596,7 @@ void shortcut_init(void)
 	const char *copy_gist =
 		N_("Copy current line (or marked region) and store it in cutbuffer");
 	const char *zap_gist = N_("Throw away the current line (or marked region)");
+	const char *follow_gist = N_("Keep adding what gets appended to the file");
 	const char *indent_gist = N_("Indent the current line (or marked lines)");
 	const char *unindent_gist = N_("Unindent the current line (or marked lines)");
 	const char *undo_gist = N_("Undo the last operation");
@@ -634,6 +654,8 @@ void shortcut_init(void)
 #ifndef NANO_TINY
 	const char *wordcount_gist =
 		N_("Count the number of words, lines, and characters");
+	const char *memstats_gist =
+		N_("Show how much memory the current buffer takes");
 #endif
 	const char *refresh_gist =
 		N_("Refresh (redraw) the current screen");
@@ -968,6 +990,8 @@ void shortcut_init(void)
 #ifndef NANO_TINY
 	add_to_funcs(do_wordlinechar_count, MMAIN,
 		N_("Word Count"), WITHORSANS(wordcount_gist), TOGETHER, VIEW);
+	add_to_funcs(do_memstats, MMAIN,
+		N_("Memory Use"), WITHORSANS(memstats_gist), TOGETHER, VIEW);
 #endif
 
 	add_to_funcs(do_verbatim_input, MMAIN,
@@ -1004,6 +1028,9 @@ void shortcut_init(void)
 	add_to_funcs(zap_text, MMAIN,
 		N_("Zap Text"), WITHORSANS(zap_gist), BLANKAFTER, NOVIEW);
 
+	add_to_funcs(do_follow, MMAIN,
+		N_("Follow"), WITHORSANS(follow_gist), BLANKAFTER, VIEW);
+
 #ifdef ENABLE_COLOR
 	if (!ISSET(RESTRICTED)) {
 		add_to_funcs(do_linter, MMAIN,
@@ -1503,6 +1530,8 @@ keystruct *strtosc(const char *input)
 		s->func = copy_text;
 	else if (!strcasecmp(input, "zap"))
 		s->func = zap_text;
+	else if (!strcasecmp(input, "follow"))
+		s->func = do_follow;
 	else if (!strcasecmp(input, "mark"))
 		s->func = do_mark;
 #endif
@@ -1556,6 +1585,8 @@ keystruct *strtosc(const char *input)
 		s->func = do_find_bracket;
 	else if (!strcasecmp(input, "wordcount"))
 		s->func = do_wordlinechar_count;
+	else if (!strcasecmp(input, "memstats"))
+		s->func = do_memstats;
 	else if (!strcasecmp(input, "recordmacro"))
 		s->func = record_macro;
 	else if (!strcasecmp(input, "runmacro"))
@@ -53,8 +53,7 @@ void wrap_help_text_into_buffer(void)
 		char *oneline = nmalloc(length + 1);
 
 		snprintf(oneline, length + 1, "%s", ptr);
-		free(openfile->current->data);
-		openfile->current->data = oneline;
+		set_data(openfile->current, oneline);
 
 		ptr += length;
 		if (*ptr != '\n')
@@ -62,9 +61,8 @@ void wrap_help_text_into_buffer(void)
 
 		/* Create a new line, and then one more for each extra \n. */
 		do {
-			openfile->current->next = make_new_node(openfile->current);
+			openfile->current->next = make_text_node(openfile->current, "");
 			openfile->current = openfile->current->next;
-			openfile->current->data = copy_of("");
 		} while (*(++ptr) == '\n');
 	}
 
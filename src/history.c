@@ -134,6 +134,7 @@ void update_history(linestruct **item, const char *text)
 
 	/* Store the fresh string in the last item, then create a new item. */
 	(*hbot)->data = mallocstrcpy((*hbot)->data, text);
+	forget_counts(*hbot);
 	splice_node(*hbot, make_new_node(*hbot));
 	*hbot = (*hbot)->next;
 	(*hbot)->data = copy_of("");
@@ -614,4 +615,17 @@ bool has_old_position(const char *file, ssize_t *line, ssize_t *column)
 	*column = posptr->xno;
 	return TRUE;
 }
+
+#ifndef NANO_TINY
+/* Return how many bytes the list of recorded file positions takes. */
+size_t position_history_size(void)
+{
+	size_t total = 0;
+
+	for (poshiststruct *posptr = position_history; posptr != NULL; posptr = posptr->next)
+		total += sizeof(poshiststruct) + strlen(posptr->filename) + 1;
+
+	return total;
+}
+#endif
 #endif /* ENABLE_HISTORIES */
@@ -26,6 +26,10 @@
 /* Move to the first line of the file. */
 void to_first_line(void)
 {
+#ifndef NANO_TINY
+	if (!bring_in_line(1))
+		return;
+#endif
 	openfile->current = openfile->filetop;
 	openfile->current_x = 0;
 	openfile->placewewant = 0;
@@ -36,6 +40,11 @@ void to_first_line(void)
 /* Move to the last line of the file. */
 void to_last_line(void)
 {
+#ifndef NANO_TINY
+	/* When the file is still being read, wait until it is complete. */
+	if (!await_loading(0) || !bring_in_line(0))
+		return;
+#endif
 	openfile->current = openfile->filebot;
 	openfile->current_x = strlen(openfile->filebot->data);
 	openfile->placewewant = xplustabs();
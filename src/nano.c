@@ -33,6 +33,9 @@
 #include <langinfo.h>
 #endif
 #include <locale.h>
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
 #include <string.h>
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
@@ -78,15 +81,51 @@ static linestruct *hindline;
 static linestruct *filetail;
 		/* What was the bottom line of the buffer. */
 
-/* Create a new linestruct node.  Note that we do not set prevnode->next. */
-linestruct *make_new_node(linestruct *prevnode)
+#ifndef NANO_TINY
+#define ARENASHIFT 16
+#define ARENABLOCK ((size_t)1 << ARENASHIFT)
+
+/* A hash table of the aligned stretches of memory that make up the registered
+ * blocks of all arenas, so that a piece can be traced back to its arena. */
+static size_t *chunkstart = NULL;
+		/* The start addresses of the stretches, or zero for an empty slot. */
+static arenastruct **chunkowner = NULL;
+		/* The arena to which each of the stretches belongs. */
+static size_t chunkslots = 0;
+		/* The size of the table -- always a power of two. */
+static size_t chunkcount = 0;
+		/* The number of stretches in the table. */
+
+/* A hash table of the line texts that are held by more than one line, as
+ * when a paste shares the texts of the cutbuffer instead of copying them. */
+static const char **sharedtext = NULL;
+		/* The shared texts, or NULL for an empty slot. */
+static size_t *sharers = NULL;
+		/* For each shared text, the number of lines that hold it. */
+static size_t sharedslots = 0;
+		/* The size of the table -- always a power of two. */
+static size_t sharedcount = 0;
+		/* The number of texts in the table. */
+
+static linestruct *reporthead = NULL;
+static linestruct *reporttail = NULL;
+		/* Beginning and end of the gathered lines of the memory report. */
+static size_t reportedtotal = 0;
+		/* The sum of the memory use of the buffers reported on so far. */
+
+static bool defer_numbering = FALSE;
+		/* Whether the function being run may leave lines unnumbered. */
+#endif
+
+/* Initialize the given fresh node as coming after prevnode.  Note that we
+ * do not set prevnode->next. */
+linestruct *set_up_node(linestruct *newnode, linestruct *prevnode)
 {
-	linestruct *newnode = nmalloc(sizeof(linestruct));
-
 	newnode->data = NULL;
 	newnode->prev = prevnode;
 	newnode->next = NULL;
 	newnode->lineno = (prevnode != NULL) ? prevnode->lineno + 1 : 1;
+	newnode->length = UNCOUNTED;
 
 #ifdef ENABLE_COLOR
 	newnode->multidata = NULL;
@@ -95,19 +134,61 @@ linestruct *make_new_node(linestruct *prevnode)
 	return newnode;
 }
 
-/* Make a copy of a linestruct node. */
-linestruct *copy_node(const linestruct *src)
+/* Create a new linestruct node.  Note that we do not set prevnode->next. */
+linestruct *make_new_node(linestruct *prevnode)
+{
+	return set_up_node(nmalloc(sizeof(linestruct)), prevnode);
+}
+
+/* Create a new linestruct node with room for a text of the given size.
+ * When the text is short, it goes right behind the node, into the same
+ * allocation, so that it goes away together with the node. */
+linestruct *make_sized_node(linestruct *prevnode, size_t size)
+{
+	linestruct *newnode;
+
+	if (size <= INLINELIMIT) {
+		newnode = set_up_node(nmalloc(sizeof(linestruct) + size), prevnode);
+		newnode->data = INLINE_DATA(newnode);
+	} else {
+		newnode = set_up_node(nmalloc(sizeof(linestruct)), prevnode);
+		newnode->data = charalloc(size);
+	}
+
+	return newnode;
+}
+
+/* Create a new linestruct node that holds a copy of the given text. */
+linestruct *make_text_node(linestruct *prevnode, const char *text)
+{
+	size_t size = strlen(text) + 1;
+	linestruct *newnode = make_sized_node(prevnode, size);
+
+	memcpy(newnode->data, text, size);
+
+	return newnode;
+}
+
+/* Make a copy of a linestruct node.  A long text does not get copied:
+ * the copy shares it with the original, until one of them changes it. */
+linestruct *copy_node(linestruct *src)
 {
-	linestruct *dst = nmalloc(sizeof(linestruct));
+	linestruct *dst;
+
+#ifndef NANO_TINY
+	if (src->data != INLINE_DATA(src) &&
+				(arena_of(src->data) == NULL || line_length(src) >= INLINELIMIT)) {
+		dst = make_new_node(NULL);
+		dst->data = share_data(src);
+	} else
+#endif
+		dst = make_text_node(NULL, src->data);
 
-	dst->data = copy_of(src->data);
 	dst->next = src->next;
 	dst->prev = src->prev;
 	dst->lineno = src->lineno;
-
-#ifdef ENABLE_COLOR
-	dst->multidata = NULL;
-#endif
+	dst->length = src->length;
+	dst->chars = src->chars;
 
 	return dst;
 }
@@ -149,15 +230,24 @@ void delete_node(linestruct *line)
 	if (line == openfile->spillage_line)
 		openfile->spillage_line = NULL;
 #endif
-	free(line->data);
+#ifndef NANO_TINY
+	/* A deleted line must not be found through the index anymore. */
+	unindex_line(line);
+#endif
+	if (line->data != INLINE_DATA(line))
+		free_data(line->data);
 #ifdef ENABLE_COLOR
 	free(line->multidata);
 #endif
-	free(line);
+#ifndef NANO_TINY
+	/* A node in an arena goes away together with the arena. */
+	if (arena_of(line) == NULL)
+#endif
+		free(line);
 }
 
 /* Duplicate an entire linked list of linestructs. */
-linestruct *copy_buffer(const linestruct *src)
+linestruct *copy_buffer(linestruct *src)
 {
 	linestruct *head, *copy;
 
@@ -193,16 +283,899 @@ void free_lines(linestruct *src)
 	delete_node(src);
 }
 
+/* Free the given line text, unless it was carved from an arena, or
+ * unless other lines still share it. */
+void free_data(char *data)
+{
+#ifndef NANO_TINY
+	if (arena_of(data) != NULL || drop_sharer(data))
+		return;
+#endif
+	free(data);
+}
+
+/* Give the given line the given text, freeing the text it had. */
+void set_data(linestruct *line, char *data)
+{
+#ifndef NANO_TINY
+	arenastruct *arena = arena_of(line->data);
+
+	/* A line of an arena that gets its text from elsewhere is no longer
+	 * as it was read in, so its arena may not skip it when freeing. */
+	if (arena != NULL && arena_of(data) != arena)
+		arena->pristine = FALSE;
+#endif
+	if (line->data != INLINE_DATA(line))
+		free_data(line->data);
+
+	line->data = data;
+	forget_counts(line);
+}
+
+/* Return the text of the given line in a form that can outlive the line,
+ * for when the line is about to get another text. */
+char *detach_data(linestruct *line)
+{
+	if (line->data == INLINE_DATA(line))
+		return copy_of(line->data);
+	else
+		return line->data;
+}
+
+/* Resize the text of the given line to the given size.  Text that is stored
+ * behind the node or that was carved from an arena stays where it is when
+ * it does not grow; otherwise it is copied onto the heap.  Text that is
+ * shared with other lines always gets copied, as it is about to change. */
+void resize_data(linestruct *line, size_t size)
+{
+	/* A line gets resized for changing it, so its counts will be off. */
+	forget_counts(line);
+
+#ifndef NANO_TINY
+	if (is_shared(line->data)) {
+		size_t length = strlen(line->data);
+		char *copy = charalloc((size > length) ? size : length + 1);
+
+		memcpy(copy, line->data, length + 1);
+		drop_sharer(line->data);
+		line->data = copy;
+	} else if (line->data == INLINE_DATA(line) || arena_of(line->data) != NULL) {
+#else
+	if (line->data == INLINE_DATA(line)) {
+#endif
+		size_t length = strlen(line->data);
+		char *copy;
+
+		if (size <= length + 1)
+			return;
+
+#ifndef NANO_TINY
+		/* Text that moves from an arena to the heap must get freed. */
+		if (arena_of(line->data) != NULL)
+			arena_of(line->data)->pristine = FALSE;
+#endif
+		copy = charalloc(size);
+		memcpy(copy, line->data, length + 1);
+		line->data = copy;
+	} else
+		line->data = charealloc(line->data, size);
+}
+
+/* Make sure that the text of the given line is its own, so that it can
+ * be changed in place without the change showing up in other lines. */
+void unshare_data(linestruct *line)
+{
+#ifndef NANO_TINY
+	if (is_shared(line->data)) {
+		char *copy = copy_of(line->data);
+
+		drop_sharer(line->data);
+		line->data = copy;
+	}
+#endif
+}
+
+/* Store the given length and number of characters of the given line,
+ * when they fit. */
+void store_counts(linestruct *line, size_t length, size_t chars)
+{
+	line->length = (length < UNCOUNTED) ? length : UNCOUNTED;
+	line->chars = chars;
+}
+
+/* Record the new length and number of characters of the given line,
+ * whose text has just changed. */
+void set_counts(linestruct *line, size_t length, size_t chars)
+{
+	store_counts(line, length, chars);
+#ifndef NANO_TINY
+	mark_stride(line);
+#endif
+}
+
+/* Note that the text of the given line has changed in some way that
+ * leaves its length and number of characters to be counted anew. */
+void forget_counts(linestruct *line)
+{
+	line->length = UNCOUNTED;
+#ifndef NANO_TINY
+	mark_stride(line);
+#endif
+}
+
+/* Return the number of bytes in the text of the given line. */
+size_t line_length(linestruct *line)
+{
+	if (line->length == UNCOUNTED)
+		store_counts(line, strlen(line->data), mbstrlen(line->data));
+
+	return (line->length != UNCOUNTED) ? line->length : strlen(line->data);
+}
+
+/* Return the number of characters in the text of the given line. */
+size_t line_chars(linestruct *line)
+{
+	if (line->length == UNCOUNTED)
+		store_counts(line, strlen(line->data), mbstrlen(line->data));
+
+	return (line->length != UNCOUNTED) ? line->chars : mbstrlen(line->data);
+}
+
+#ifndef NANO_TINY
+/* Return the slot in the table where a stretch with the given start belongs. */
+size_t chunk_home(size_t start)
+{
+	return ((start >> ARENASHIFT) * 2654435761u) & (chunkslots - 1);
+}
+
+/* Return the slot in the table that holds the given start, or else
+ * the empty slot where it would go. */
+size_t chunk_slot(size_t start)
+{
+	size_t slot = chunk_home(start);
+
+	while (chunkstart[slot] != 0 && chunkstart[slot] != start)
+		slot = (slot + 1) & (chunkslots - 1);
+
+	return slot;
+}
+
+/* Record in the table that the given stretch belongs to the given arena. */
+void add_chunk(size_t start, arenastruct *arena)
+{
+	size_t slot;
+
+	/* Keep the table at most half full, so that the probing stays short. */
+	if (2 * (chunkcount + 1) > chunkslots) {
+		size_t *oldstart = chunkstart;
+		arenastruct **oldowner = chunkowner;
+		size_t oldslots = chunkslots;
+
+		chunkslots = (chunkslots == 0) ? 256 : 2 * chunkslots;
+		chunkstart = nmalloc(chunkslots * sizeof(size_t));
+		chunkowner = nmalloc(chunkslots * sizeof(arenastruct *));
+
+		for (slot = 0; slot < chunkslots; slot++)
+			chunkstart[slot] = 0;
+
+		for (size_t index = 0; index < oldslots; index++)
+			if (oldstart[index] != 0) {
+				slot = chunk_slot(oldstart[index]);
+				chunkstart[slot] = oldstart[index];
+				chunkowner[slot] = oldowner[index];
+			}
+
+		free(oldstart);
+		free(oldowner);
+	}
+
+	slot = chunk_slot(start);
+	chunkstart[slot] = start;
+	chunkowner[slot] = arena;
+	chunkcount++;
+}
+
+/* Remove the given stretch from the table, moving later entries of the
+ * same cluster back into the hole when they may live there. */
+void remove_chunk(size_t start)
+{
+	size_t hole = chunk_slot(start);
+	size_t slot = hole, home;
+
+	chunkstart[hole] = 0;
+	chunkcount--;
+
+	while (TRUE) {
+		slot = (slot + 1) & (chunkslots - 1);
+
+		if (chunkstart[slot] == 0)
+			return;
+
+		home = chunk_home(chunkstart[slot]);
+
+		if ((hole < slot) ? (home <= hole || home > slot) :
+							(home <= hole && home > slot)) {
+			chunkstart[hole] = chunkstart[slot];
+			chunkowner[hole] = chunkowner[slot];
+			chunkstart[slot] = 0;
+			hole = slot;
+		}
+	}
+}
+
+/* Return the arena that the given piece was carved from, or NULL when
+ * the piece lives on the heap (or has not been registered yet). */
+arenastruct *arena_of(const void *piece)
+{
+	size_t slot;
+
+	if (chunkcount == 0 || piece == NULL)
+		return NULL;
+
+	slot = chunk_slot((size_t)piece & ~(ARENABLOCK - 1));
+
+	return (chunkstart[slot] == 0) ? NULL : chunkowner[slot];
+}
+
+/* Create a new, empty arena. */
+arenastruct *make_arena(void)
+{
+	arenastruct *arena = nmalloc(sizeof(arenastruct));
+
+	arena->spot = NULL;
+	arena->room = 0;
+	arena->blocks = NULL;
+	arena->fresh = NULL;
+	arena->pristine = TRUE;
+
+	return arena;
+}
+
+/* Carve a piece of the given size out of the given arena -- aligned for
+ * a node when asked to.  Such a piece cannot be freed on its own: it goes
+ * away with the arena.  This is safe to call from a thread that has the
+ * arena to itself, as the new blocks do not get registered here. */
+void *carve(arenastruct *arena, size_t size, bool aligned)
+{
+	size_t skip = aligned ? -(size_t)arena->spot & (sizeof(void *) - 1) : 0;
+	blockstruct *block;
+	size_t span = ARENABLOCK;
+	void *piece;
+
+	if (skip + size <= arena->room) {
+		piece = arena->spot + skip;
+		arena->spot += skip + size;
+		arena->room -= skip + size;
+		return piece;
+	}
+
+	/* A piece that does not fit in a normal block gets a block of its own. */
+	while (span < sizeof(blockstruct) + size)
+		span += ARENABLOCK;
+
+	if (posix_memalign((void **)&block, ARENABLOCK, span) != 0)
+		die(_("Nano is out of memory!\n"));
+
+	block->next = arena->fresh;
+	block->size = span;
+	arena->fresh = block;
+
+	piece = (char *)block + sizeof(blockstruct);
+
+	/* Continue in the new block only when it has more room left. */
+	if (span - sizeof(blockstruct) - size > arena->room) {
+		arena->spot = (char *)piece + size;
+		arena->room = span - sizeof(blockstruct) - size;
+	}
+
+	return piece;
+}
+
+/* Register the blocks in the given list as blocks of the given arena,
+ * so that their pieces get recognized, and move them into that arena. */
+void adopt_blocks(arenastruct *arena, blockstruct **list)
+{
+	while (*list != NULL) {
+		blockstruct *block = *list;
+
+		for (size_t offset = 0; offset < block->size; offset += ARENABLOCK)
+			add_chunk((size_t)block + offset, arena);
+
+		*list = block->next;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+}
+
+/* Free the given arena, and with it all the pieces that were carved from it. */
+void free_arena(arenastruct *arena)
+{
+	while (arena->blocks != NULL) {
+		blockstruct *block = arena->blocks;
+
+		for (size_t offset = 0; offset < block->size; offset += ARENABLOCK)
+			remove_chunk((size_t)block + offset);
+
+		arena->blocks = block->next;
+		free(block);
+	}
+
+	while (arena->fresh != NULL) {
+		blockstruct *block = arena->fresh;
+
+		arena->fresh = block->next;
+		free(block);
+	}
+
+	free(arena);
+}
+
+/* Create a new node in the given arena.  Note that we do not set prevnode->next. */
+linestruct *make_arena_node(arenastruct *arena, linestruct *prevnode)
+{
+	return set_up_node(carve(arena, sizeof(linestruct), TRUE), prevnode);
+}
+
+/* When any of the given lines lives in the given arena, replace the lines
+ * with a copy that does not, and return that copy; else return the lines. */
+linestruct *lift_from_arena(linestruct *list, const arenastruct *arena)
+{
+	for (linestruct *line = list; line != NULL; line = line->next)
+		if (arena_of(line) == arena || arena_of(line->data) == arena) {
+			linestruct *copy = copy_buffer(list);
+
+			free_lines(list);
+			return copy;
+		}
+
+	return list;
+}
+
+/* Free the lines of the given buffer together with the arena they were
+ * carved from.  When the lines are still as they were read in, only the
+ * first and the last line can have something on the heap, so then there
+ * is no need to go through all of them. */
+void free_arena_lines(openfilestruct *buffer)
+{
+	arenastruct *arena = buffer->arena;
+	linestruct *lifted = lift_from_arena(cutbuffer, arena);
+
+	/* Lines that were cut from this buffer must outlive its arena. */
+	if (lifted != cutbuffer) {
+		cutbuffer = lifted;
+		cutbottom = lifted;
+		while (cutbottom->next != NULL)
+			cutbottom = cutbottom->next;
+	}
+
+	if (!arena->pristine)
+		free_lines(buffer->filetop);
+	else {
+		if (buffer->filebot != buffer->filetop)
+			delete_node(buffer->filebot);
+		delete_node(buffer->filetop);
+	}
+
+	free_arena(arena);
+}
+
+/* Return the slot in the table where the given text belongs. */
+size_t text_home(const char *text)
+{
+	return (((size_t)text >> 4) * 2654435761u) & (sharedslots - 1);
+}
+
+/* Return the slot in the table that holds the given text, or else
+ * the empty slot where it would go. */
+size_t text_slot(const char *text)
+{
+	size_t slot = text_home(text);
+
+	while (sharedtext[slot] != NULL && sharedtext[slot] != text)
+		slot = (slot + 1) & (sharedslots - 1);
+
+	return slot;
+}
+
+/* Return TRUE when the given text is held by more than one line. */
+bool is_shared(const char *text)
+{
+	return (sharedcount > 0 && text != NULL && sharedtext[text_slot(text)] != NULL);
+}
+
+/* Record that one more line holds the given text. */
+void add_sharer(const char *text)
+{
+	size_t slot;
+
+	if (is_shared(text)) {
+		sharers[text_slot(text)]++;
+		return;
+	}
+
+	/* Keep the table at most half full, so that the probing stays short. */
+	if (2 * (sharedcount + 1) > sharedslots) {
+		const char **oldtext = sharedtext;
+		size_t *oldsharers = sharers;
+		size_t oldslots = sharedslots;
+
+		sharedslots = (sharedslots == 0) ? 256 : 2 * sharedslots;
+		sharedtext = nmalloc(sharedslots * sizeof(char *));
+		sharers = nmalloc(sharedslots * sizeof(size_t));
+
+		for (slot = 0; slot < sharedslots; slot++)
+			sharedtext[slot] = NULL;
+
+		for (size_t index = 0; index < oldslots; index++)
+			if (oldtext[index] != NULL) {
+				slot = text_slot(oldtext[index]);
+				sharedtext[slot] = oldtext[index];
+				sharers[slot] = oldsharers[index];
+			}
+
+		free(oldtext);
+		free(oldsharers);
+	}
+
+	slot = text_slot(text);
+	sharedtext[slot] = text;
+	sharers[slot] = 2;
+	sharedcount++;
+}
+
+/* Record that one line less holds the given text.  When just one is left,
+ * remove the text from the table, moving later entries of the same cluster
+ * back into the hole when they may live there.  Return FALSE when the text
+ * was not shared, meaning that its last holder lets go of it. */
+bool drop_sharer(const char *text)
+{
+	size_t hole, slot, home;
+
+	if (!is_shared(text))
+		return FALSE;
+
+	hole = text_slot(text);
+
+	if (--sharers[hole] > 1)
+		return TRUE;
+
+	sharedtext[hole] = NULL;
+	sharedcount--;
+	slot = hole;
+
+	while (TRUE) {
+		slot = (slot + 1) & (sharedslots - 1);
+
+		if (sharedtext[slot] == NULL)
+			return TRUE;
+
+		home = text_home(sharedtext[slot]);
+
+		if ((hole < slot) ? (home <= hole || home > slot) :
+							(home <= hole && home > slot)) {
+			sharedtext[hole] = sharedtext[slot];
+			sharers[hole] = sharers[slot];
+			sharedtext[slot] = NULL;
+			hole = slot;
+		}
+	}
+}
+
+/* Return the text of the given line in a form that another line can hold
+ * too.  A text in an arena first gets moved onto the heap, as the arena
+ * may go away before the other line does. */
+char *share_data(linestruct *line)
+{
+	arenastruct *arena = arena_of(line->data);
+
+	if (arena != NULL) {
+		arena->pristine = FALSE;
+		line->data = copy_of(line->data);
+	}
+
+	add_sharer(line->data);
+
+	return line->data;
+}
+
+/* Return how many bytes the given allocation really takes, or the wanted
+ * size when the C library cannot tell. */
+size_t allocated_size(void *piece, size_t wanted)
+{
+#ifdef HAVE_MALLOC_USABLE_SIZE
+	return malloc_usable_size(piece);
+#else
+	return wanted;
+#endif
+}
+
+/* Return the number of bytes in all the blocks of the given arena. */
+size_t arena_size(const arenastruct *arena)
+{
+	size_t total = 0;
+
+	for (blockstruct *block = arena->blocks; block != NULL; block = block->next)
+		total += block->size;
+	for (blockstruct *block = arena->fresh; block != NULL; block = block->next)
+		total += block->size;
+
+	return total;
+}
+
+/* Return what the given lines take in memory, for lines whose coloring info
+ * has the given number of entries.  When a tally is given, add the details
+ * to it, and add the size of the pieces that were carved from the given
+ * arena to carved, so that the unused part of the arena can be known. */
+size_t tally_lines(linestruct *line, size_t multis, const arenastruct *arena,
+		memstruct *tally, size_t *carved)
+{
+	size_t total = 0;
+
+	for (; line != NULL; line = line->next) {
+		size_t length = line_length(line) + 1;
+		bool in_arena = (arena_of(line) != NULL);
+		size_t slack = 0, colors = 0;
+
+		/* Text right behind a node on the heap shares its allocation. */
+		if (!in_arena && line->data == INLINE_DATA(line))
+			slack = allocated_size(line, sizeof(linestruct) + length) -
+								sizeof(linestruct) - length;
+		else {
+			if (!in_arena)
+				slack = allocated_size(line, sizeof(linestruct)) - sizeof(linestruct);
+			else if (tally != NULL && arena_of(line) == arena)
+				*carved += sizeof(linestruct);
+
+			if (arena != NULL && arena_of(line->data) == arena) {
+				if (tally != NULL)
+					*carved += length;
+			} else if (line->data != INLINE_DATA(line) && arena_of(line->data) == NULL)
+				slack += allocated_size(line->data, length) - length;
+
+			if (tally != NULL && is_shared(line->data))
+				tally->shared += length;
+		}
+
+#ifdef ENABLE_COLOR
+		if (line->multidata != NULL)
+			colors = multis * sizeof(short);
+#endif
+
+		if (tally != NULL) {
+			tally->lines++;
+			tally->nodes += sizeof(linestruct);
+			tally->text += length;
+			tally->slack += slack;
+			tally->colors += colors;
+		}
+
+		total += sizeof(linestruct) + length + slack + colors;
+	}
+
+	return total;
+}
+
+/* Fill the given tally with what the given buffer takes in memory. */
+void tally_buffer(openfilestruct *buffer, memstruct *tally)
+{
+	size_t multis = 0, carved = 0;
+
+	memset(tally, 0, sizeof(memstruct));
+
+#ifdef ENABLE_COLOR
+	if (buffer->syntax != NULL)
+		multis = buffer->syntax->nmultis;
+#endif
+
+	/* An idle buffer that was packed has no lines, just blocks. */
+	if (buffer->packed != NULL) {
+		tally->packed = sizeof(packstruct);
+		for (packblockstruct *block = buffer->packed->first; block != NULL;
+											block = block->next)
+			tally->packed += sizeof(packblockstruct) + block->size;
+	} else
+		tally_lines(buffer->filetop, multis, buffer->arena, tally, &carved);
+
+	/* What the arena holds beyond the lines of the buffer is slack. */
+	if (buffer->arena != NULL && arena_size(buffer->arena) > carved)
+		tally->slack += arena_size(buffer->arena) - carved;
+
+	if (buffer->indexroom > 0)
+		tally->index = buffer->indexroom * (sizeof(linestruct *) + sizeof(size_t)) +
+							(buffer->indexroom + 1) * sizeof(size_t);
+
+	for (undostruct *item = buffer->undotop; item != NULL; item = item->next) {
+		tally->items++;
+		tally->undo += sizeof(undostruct);
+
+		if (item->strdata != NULL)
+			tally->undotext += strlen(item->strdata) + 1;
+
+		tally->undolines += tally_lines(item->cutbuffer, multis, NULL, NULL, NULL);
+
+		for (groupstruct *group = item->grouping; group != NULL; group = group->next) {
+			size_t count = group->bottom_line - group->top_line + 1;
+
+			tally->grouping += sizeof(groupstruct) + count * sizeof(char *);
+			for (size_t index = 0; index < count; index++)
+				tally->grouping += strlen(group->indentations[index]) + 1;
+		}
+	}
+}
+
+/* Return the sum of everything in the given tally. */
+size_t tally_total(const memstruct *tally)
+{
+	return tally->nodes + tally->text + tally->slack + tally->colors + tally->index +
+				tally->packed + tally->undo + tally->undotext + tally->undolines +
+				tally->grouping;
+}
+
+/* Return what the cutbuffer and the history lists take, via the parameters. */
+void tally_the_rest(size_t *cut, size_t *history)
+{
+	size_t multis = 0;
+
+#ifdef ENABLE_COLOR
+	if (openfile->syntax != NULL)
+		multis = openfile->syntax->nmultis;
+#endif
+
+	*cut = tally_lines(cutbuffer, multis, NULL, NULL, NULL);
+	*history = 0;
+
+#ifdef ENABLE_HISTORIES
+	*history += tally_lines(searchtop, 0, NULL, NULL, NULL);
+	*history += tally_lines(replacetop, 0, NULL, NULL, NULL);
+	*history += tally_lines(executetop, 0, NULL, NULL, NULL);
+	*history += position_history_size();
+#endif
+}
+
+/* Show on the status bar what the current buffer takes in memory, in kilobytes. */
+void do_memstats(void)
+{
+	memstruct tally;
+	size_t cut, history;
+
+	tally_buffer(openfile, &tally);
+	tally_the_rest(&cut, &history);
+
+	statusline(HUSH, _("Buffer: %zuK (nodes %zuK, text %zuK, slack %zuK, colors %zuK, "
+					"index %zuK, packed %zuK, undo %zuK)  Cut: %zuK  History: %zuK"),
+					tally_total(&tally) >> 10,
+					tally.nodes >> 10, tally.text >> 10, tally.slack >> 10,
+					tally.colors >> 10, tally.index >> 10, tally.packed >> 10,
+					(tally.undo + tally.undotext + tally.undolines + tally.grouping) >> 10,
+					cut >> 10, history >> 10);
+}
+
+/* Store the given line of the memory report, to be printed upon exit. */
+void jot_report(const char *format, ...)
+{
+	linestruct *line = make_new_node(reporttail);
+	char textbuf[PATH_MAX + 200];
+	va_list ap;
+
+	if (reporthead == NULL)
+		reporthead = line;
+	else
+		reporttail->next = line;
+	reporttail = line;
+
+	va_start(ap, format);
+	vsnprintf(textbuf, sizeof(textbuf), format, ap);
+	va_end(ap);
+
+	line->data = copy_of(textbuf);
+}
+
+/* Store one labeled number of the memory report, indented to the given depth. */
+void report_item(int depth, const char *label, size_t number)
+{
+	jot_report("%*s%-*s %12zu", 2 * depth, "", 24 - 2 * depth, label, number);
+}
+
+/* Gather the lines of the memory report for the given buffer.  This is done
+ * for each buffer when it gets closed, so that all of them are covered. */
+void report_buffer(openfilestruct *buffer)
+{
+	memstruct tally;
+
+	tally_buffer(buffer, &tally);
+	reportedtotal += tally_total(&tally);
+
+	jot_report("");
+	jot_report("  %s", buffer->filename[0] == '\0' ? _("New Buffer") : buffer->filename);
+	report_item(2, _("lines"), tally.lines);
+	report_item(2, _("line nodes"), tally.nodes);
+	report_item(2, _("line text"), tally.text);
+	report_item(3, _("shared"), tally.shared);
+	report_item(2, _("slack"), tally.slack);
+#ifdef ENABLE_COLOR
+	report_item(2, _("multidata"), tally.colors);
+#endif
+	report_item(2, _("line index"), tally.index);
+	report_item(2, _("packed text"), tally.packed);
+	report_item(2, _("undo items"), tally.items);
+	report_item(3, _("structs"), tally.undo);
+	report_item(3, _("strdata"), tally.undotext);
+	report_item(3, _("cutbuffers"), tally.undolines);
+	report_item(3, _("indentations"), tally.grouping);
+	report_item(2, _("total"), tally_total(&tally));
+}
+
+/* Write to standard error what each buffer took in memory, in bytes --
+ * the ones that were closed earlier, and the ones that are still open. */
+void report_memstats(void)
+{
+	openfilestruct *buffer = openfile;
+	size_t cut, history;
+
+	if (openfile == NULL)
+		return;
+
+#ifdef ENABLE_MULTIBUFFER
+	buffer = startfile;
+#endif
+
+	do {
+		report_buffer(buffer);
+#ifdef ENABLE_MULTIBUFFER
+		buffer = buffer->next;
+	} while (buffer != startfile);
+#else
+	} while (FALSE);
+#endif
+
+	tally_the_rest(&cut, &history);
+
+	jot_report("");
+	report_item(1, _("cutbuffer"), cut);
+	report_item(1, _("history lists"), history);
+	report_item(1, _("total"), reportedtotal + cut + history);
+
+	fprintf(stderr, _("Memory use per buffer, in bytes:\n"));
+
+	for (linestruct *line = reporthead; line != NULL; line = line->next)
+		fprintf(stderr, "%s\n", line->data);
+}
+#endif /* !NANO_TINY */
+
 /* Renumber the lines in a buffer, from the given line onwards. */
 void renumber_from(linestruct *line)
 {
 	ssize_t number = (line->prev == NULL) ? 0 : line->prev->lineno;
+#ifndef NANO_TINY
+	ssize_t first;
 
-	while (line != NULL) {
+	/* Where the line before the given one might lag behind, catch up first. */
+	if (openfile != NULL && openfile->unnumbered != NULL) {
+		renumber_the_rest();
+		number = (line->prev == NULL) ? 0 : line->prev->lineno;
+	}
+
+	/* The first line in memory of a huge file need not be its first line. */
+	if (line->prev == NULL && openfile->window != NULL && line == openfile->filetop)
+		number = openfile->window->topline - 1;
+
+	first = number + 1;
+#endif
+
+	line->lineno = ++number;
+
+	while (line->next != NULL) {
+		line = line->next;
+		line->lineno = ++number;
+	}
+
+#ifndef NANO_TINY
+	/* From the first renumbered line on, the index of the buffer is void. */
+	forget_index_from(line, first);
+#endif
+}
+
+/* Number the lines from first through last, which have just replaced some
+ * lines of the current buffer.  When the running function allows it, leave
+ * the lines that are far below to be renumbered later, when they are needed:
+ * then editing near the top of a huge file doesn't walk through all of it. */
+void renumber_span(linestruct *first, linestruct *last)
+{
+#ifndef NANO_TINY
+	linestruct *line = last->next;
+	bool passed = (openfile->unnumbered == NULL);
+	int reach = 2 * editwinrows + 2;
+	ssize_t number, was, delta;
+
+	if (!defer_numbering || openfile->window != NULL || line == NULL) {
+		renumber_from(first);
+		return;
+	}
+
+	number = (first->prev == NULL) ? 0 : first->prev->lineno;
+
+	for (linestruct *item = first; item != line; item = item->next)
+		item->lineno = ++number;
+
+	/* The line after the span still has the number it had before. */
+	was = line->lineno;
+	if (line == openfile->unnumbered)
+		was += openfile->lag;
+
+	delta = number + 1 - was;
+
+	/* The lines of the span are new, or may have been indexed elsewhere. */
+	forget_index_from(openfile->filebot, first->lineno);
+
+	/* When the number of lines didn't change, the rest is still right. */
+	if (delta == 0)
+		return;
+
+	/* Renumber the lines until past the ones that lagged behind already,
+	 * and some more, so that the edit window will show correct numbers. */
+	while (line != NULL && (!passed || reach > 0 || line->next == NULL)) {
+		if (line == openfile->unnumbered)
+			passed = TRUE;
 		line->lineno = ++number;
 		line = line->next;
+		reach--;
+	}
+
+	if (line != NULL) {
+		if (openfile->unnumbered == NULL)
+			openfile->lag = 0;
+		openfile->lag += delta;
+		openfile->filebot->lineno += delta;
+	}
+
+	openfile->unnumbered = line;
+#else
+	renumber_from(first);
+#endif
+}
+
+#ifndef NANO_TINY
+/* Make sure that the lines in the edit window, and a screenful after it,
+ * have their right numbers -- assuming that the top line of the window
+ * does not lag behind. */
+void renumber_ahead(void)
+{
+	linestruct *line = openfile->edittop;
+	int reach = 2 * editwinrows + 2;
+
+	if (openfile->unnumbered == NULL)
+		return;
+
+	while (line != openfile->unnumbered && line->next != NULL && reach > 0) {
+		line = line->next;
+		reach--;
+	}
+
+	if (line != openfile->unnumbered)
+		return;
+
+	while (line != NULL && (reach > 0 || line->next == NULL)) {
+		line->lineno = line->prev->lineno + 1;
+		line = line->next;
+		reach--;
+	}
+
+	openfile->unnumbered = line;
+}
+
+/* Give all lines of the current buffer that lag behind their right number. */
+void renumber_the_rest(void)
+{
+	linestruct *line = openfile->unnumbered;
+
+	openfile->unnumbered = NULL;
+
+	while (line != NULL) {
+		line->lineno = line->prev->lineno + 1;
+		line = line->next;
 	}
 }
+#endif
 
 /* Partition the current buffer so that it appears to begin at (top, top_x)
  * and appears to end at (bot, bot_x). */
@@ -236,10 +1209,18 @@ void partition_buffer(linestruct *top, size_t top_x,
 	postdata = copy_of(bot->data + bot_x);
 
 	/* At the end of the partition, remove all text after bot_x. */
-	bot->data[bot_x] = '\0';
+	if (*postdata != '\0') {
+		unshare_data(bot);
+		bot->data[bot_x] = '\0';
+		forget_counts(bot);
+	}
 
 	/* At the beginning of the partition, remove all text before top_x. */
-	memmove(top->data, top->data + top_x, strlen(top->data) - top_x + 1);
+	if (top_x > 0) {
+		unshare_data(top);
+		memmove(top->data, top->data + top_x, strlen(top->data) - top_x + 1);
+		forget_counts(top);
+	}
 }
 
 /* Unpartition the current buffer so that it is complete again. */
@@ -251,11 +1232,13 @@ void unpartition_buffer(void)
 		foreline->next = openfile->filetop;
 
 	/* Restore the text that was on the first partition line before its start. */
-	openfile->filetop->data = charealloc(openfile->filetop->data,
-				strlen(antedata) + strlen(openfile->filetop->data) + 1);
-	memmove(openfile->filetop->data + strlen(antedata),
-				openfile->filetop->data, strlen(openfile->filetop->data) + 1);
-	strncpy(openfile->filetop->data, antedata, strlen(antedata));
+	if (*antedata != '\0') {
+		resize_data(openfile->filetop,
+					strlen(antedata) + strlen(openfile->filetop->data) + 1);
+		memmove(openfile->filetop->data + strlen(antedata),
+					openfile->filetop->data, strlen(openfile->filetop->data) + 1);
+		strncpy(openfile->filetop->data, antedata, strlen(antedata));
+	}
 	free(antedata);
 	antedata = NULL;
 
@@ -265,9 +1248,11 @@ void unpartition_buffer(void)
 		hindline->prev = openfile->filebot;
 
 	/* Restore the text that was on the last partition line after its end. */
-	openfile->filebot->data = charealloc(openfile->filebot->data,
-				strlen(openfile->filebot->data) + strlen(postdata) + 1);
-	strcat(openfile->filebot->data, postdata);
+	if (*postdata != '\0') {
+		resize_data(openfile->filebot,
+					strlen(openfile->filebot->data) + strlen(postdata) + 1);
+		strcat(openfile->filebot->data, postdata);
+	}
 	free(postdata);
 	postdata = NULL;
 
@@ -279,6 +1264,74 @@ void unpartition_buffer(void)
 		openfile->filebot = filetail;
 }
 
+/* Append the lines from head to tail to the cutbuffer: the text of the
+ * first of them gets tacked onto the last line that is there already. */
+void add_to_cutbuffer(linestruct *head, linestruct *tail)
+{
+	if (cutbuffer == NULL) {
+		cutbuffer = head;
+		cutbottom = tail;
+		return;
+	}
+
+	resize_data(cutbottom, strlen(cutbottom->data) + strlen(head->data) + 1);
+	strcat(cutbottom->data, head->data);
+
+	/* Attach the second line (if any) to the last line of the cutbuffer,
+	 * then remove the now superfluous first line. */
+	cutbottom->next = head->next;
+	if (head->next != NULL) {
+		head->next->prev = cutbottom;
+		cutbottom = tail;
+	}
+
+	delete_node(head);
+}
+
+#ifndef NANO_TINY
+/* Move the whole lines from top until just before bot from the current buffer
+ * into the cutbuffer, by unlinking them in one go: their text stays where it
+ * is, and the lines below them keep theirs too. */
+void extract_lines(linestruct *top, linestruct *bot)
+{
+	linestruct *last = bot->prev;
+	bool edittop_inside = (openfile->edittop->lineno >= top->lineno &&
+							openfile->edittop->lineno < bot->lineno);
+	bool mark_inside = (openfile->mark != NULL &&
+							openfile->mark->lineno >= top->lineno &&
+							openfile->mark->lineno < bot->lineno);
+
+	openfile->totsize -= region_size(top, 0, bot, 0);
+
+	/* Unlink the lines, and let bot take the place of the first of them. */
+	bot->prev = top->prev;
+	if (top->prev != NULL)
+		top->prev->next = bot;
+	else
+		openfile->filetop = bot;
+
+	top->prev = NULL;
+
+	/* As the cut text ends with a newline, it ends with an empty line. */
+	last->next = make_text_node(last, "");
+	add_to_cutbuffer(top, last->next);
+
+	openfile->current = bot;
+	openfile->current_x = 0;
+	if (mark_inside) {
+		openfile->mark = bot;
+		openfile->mark_x = 0;
+	}
+
+	renumber_span(bot, bot);
+
+	if (edittop_inside) {
+		adjust_viewport(STATIONARY);
+		refresh_needed = TRUE;
+	}
+}
+#endif
+
 /* Move all text between (top, top_x) and (bot, bot_x) from the current buffer
  * into the cutbuffer. */
 void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
@@ -290,8 +1343,17 @@ void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
 
 	if (top == bot && top_x == bot_x)
 		return;
+
+	/* Whole lines can be moved without going through them. */
+	if (top_x == 0 && bot_x == 0 && top != bot) {
+		extract_lines(top, bot);
+		return;
+	}
 #endif
 
+	/* Subtract the number of characters in the text from the file size. */
+	openfile->totsize -= region_size(top, top_x, bot, bot_x);
+
 	/* Partition the buffer so that it contains only the text from
 	 * (top, top_x) to (bot, bot_x), keep track of whether the top of
 	 * the edit window is inside the partition, and keep track of
@@ -311,38 +1373,11 @@ void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
 	}
 #endif
 
-	/* Subtract the number of characters in the text from the file size. */
-	openfile->totsize -= get_totsize(top, bot);
-
-	/* If the given buffer is empty, just move all the text directly into it;
-	 * otherwise, append the text to what is already there. */
-	if (cutbuffer == NULL) {
-		cutbuffer = openfile->filetop;
-		cutbottom = openfile->filebot;
-	} else {
-		/* Tack the data of the first line of the text onto the data of
-		 * the last line in the given buffer. */
-		cutbottom->data = charealloc(cutbottom->data,
-								strlen(cutbottom->data) +
-								strlen(openfile->filetop->data) + 1);
-		strcat(cutbottom->data, openfile->filetop->data);
-
-		/* Attach the second line of the text (if any) to the last line
-		 * of the buffer, then remove the now superfluous first line. */
-		cutbottom->next = openfile->filetop->next;
-		delete_node(openfile->filetop);
-
-		/* If there is a second line, make the reverse attachment too and
-		 * update the buffer pointer to point at the end of the text. */
-		if (cutbottom->next != NULL) {
-			cutbottom->next->prev = cutbottom;
-			cutbottom = openfile->filebot;
-		}
-	}
+	/* Move the text into the cutbuffer, or append it to what is there. */
+	add_to_cutbuffer(openfile->filetop, openfile->filebot);
 
 	/* Since the text has now been saved, remove it from the file buffer. */
-	openfile->filetop = make_new_node(NULL);
-	openfile->filetop->data = copy_of("");
+	openfile->filetop = make_text_node(NULL, "");
 	openfile->filebot = openfile->filetop;
 
 	/* Restore the current line and cursor position.  If the mark begins
@@ -363,7 +1398,7 @@ void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
 	 * again, minus the saved text. */
 	unpartition_buffer();
 
-	renumber_from(openfile->current);
+	renumber_span(openfile->current, openfile->current);
 
 	/* If the top of the edit window was inside the old partition, put
 	 * it in range of current. */
@@ -377,15 +1412,111 @@ void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
 		new_magicline();
 }
 
+#ifndef NANO_TINY
+/* Add a copy of all text between (top, top_x) and (bot, bot_x) to the
+ * cutbuffer, in the same way as extract() would, but without touching
+ * the current buffer.  Whole lines share their text with the copies. */
+void copy_region(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
+{
+	linestruct *head, *tail;
+
+	if (top == bot && top_x == bot_x)
+		return;
+
+	/* The first line of the copy starts at top_x; when the region does not
+	 * span lines, it ends at bot_x. */
+	if (top_x == 0 && top != bot)
+		head = copy_node(top);
+	else {
+		size_t length = ((top == bot) ? bot_x : strlen(top->data)) - top_x;
+
+		head = make_sized_node(NULL, length + 1);
+		memcpy(head->data, top->data + top_x, length);
+		head->data[length] = '\0';
+	}
+
+	head->prev = NULL;
+	head->lineno = top->lineno;
+	tail = head;
+
+	if (top != bot) {
+		for (linestruct *line = top->next; line != bot; line = line->next) {
+			tail->next = copy_node(line);
+			tail->next->prev = tail;
+			tail = tail->next;
+		}
+
+		/* The last line of the copy ends at bot_x. */
+		tail->next = make_sized_node(tail, bot_x + 1);
+		tail = tail->next;
+		memcpy(tail->data, bot->data, bot_x);
+		tail->data[bot_x] = '\0';
+		tail->lineno = bot->lineno;
+	}
+
+	tail->next = NULL;
+
+	add_to_cutbuffer(head, tail);
+}
+#endif
+
+#ifndef NANO_TINY
+/* Link the whole lines from topline until just before bottomline (which is
+ * empty and gets deleted) into the current buffer above the current line,
+ * without touching the text of any line.  The lines hold size characters. */
+void ingraft_lines(linestruct *topline, linestruct *bottomline, size_t size)
+{
+	linestruct *lastline = bottomline->prev;
+
+	topline->prev = openfile->current->prev;
+	if (topline->prev != NULL)
+		topline->prev->next = topline;
+	else
+		openfile->filetop = topline;
+
+	lastline->next = openfile->current;
+	openfile->current->prev = lastline;
+
+	delete_node(bottomline);
+
+	/* The current line keeps its node, so a mark on it stays at its place
+	 * in the text after the pasted lines -- where ingraft_buffer() puts it
+	 * too when the cursor is at x zero, as the mark cannot be before it. */
+
+	if (openfile->edittop == openfile->current)
+		openfile->edittop = topline;
+
+	openfile->totsize += size;
+
+	renumber_span(topline, openfile->current);
+}
+#endif
+
 /* Meld the buffer that starts at topline into the current file buffer
  * at the current cursor position. */
 void ingraft_buffer(linestruct *topline)
 {
 	size_t current_x_save = openfile->current_x;
+	linestruct *bottomline = topline;
+	size_t size = line_chars(topline);
 	bool edittop_inside;
 #ifndef NANO_TINY
 	bool right_side_up = FALSE;
 	bool same_line = FALSE;
+#endif
+
+	/* Find the end of the passed buffer, counting its characters on the way. */
+	while (bottomline->next != NULL) {
+		bottomline = bottomline->next;
+		size += line_chars(bottomline) + 1;
+	}
+
+#ifndef NANO_TINY
+	/* Whole lines pasted at the start of a line can simply be linked in. */
+	if (current_x_save == 0 && bottomline != topline && bottomline->data[0] == '\0') {
+		ingraft_lines(topline, bottomline, size);
+		return;
+	}
 
 	/* Remember whether mark and cursor are on the same line, and their order. */
 	if (openfile->mark) {
@@ -405,9 +1536,7 @@ void ingraft_buffer(linestruct *topline)
 	/* Put the top and bottom of the current buffer at the top and
 	 * bottom of the passed buffer. */
 	openfile->filetop = topline;
-	openfile->filebot = topline;
-	while (openfile->filebot->next != NULL)
-		openfile->filebot = openfile->filebot->next;
+	openfile->filebot = bottomline;
 
 	/* Put the cursor at the end of the pasted text. */
 	openfile->current = openfile->filebot;
@@ -431,7 +1560,7 @@ void ingraft_buffer(linestruct *topline)
 #endif
 
 	/* Add the number of characters in the copied text to the file size. */
-	openfile->totsize += get_totsize(openfile->filetop, openfile->filebot);
+	openfile->totsize += size;
 
 	/* If we pasted onto the first line of the edit window, the corresponding
 	 * record has been freed, so... point at the start of the copied text. */
@@ -442,7 +1571,7 @@ void ingraft_buffer(linestruct *topline)
 	 * again, plus the copied text. */
 	unpartition_buffer();
 
-	renumber_from(topline);
+	renumber_span(topline, openfile->current);
 
 	/* If the text doesn't end with a newline, and it should, add one. */
 	if (!ISSET(NO_NEWLINES) && openfile->filebot->data[0] != '\0')
@@ -517,6 +1646,12 @@ void finish(void)
 	}
 #endif
 
+#ifndef NANO_TINY
+	/* When asked, tell where the memory went. */
+	if (ISSET(MEMORY_STATS))
+		report_memstats();
+#endif
+
 	/* Get out. */
 	exit(0);
 }
@@ -556,7 +1691,20 @@ void die(const char *msg, ...)
 		if (openfile->modified && !ISSET(RESTRICTED)) {
 			if (antedata != NULL)
 				unpartition_buffer();
+#if defined(ENABLE_MULTIBUFFER) && !defined(NANO_TINY)
+			/* An idle buffer needs its lines back for being saved. */
+			if (openfile->packed != NULL)
+				unpack_buffer();
+#endif
 
+#ifndef NANO_TINY
+			/* When the edits are safe in a journal, there is no need for
+			 * an emergency save; just say where they can be found. */
+			if (openfile->journal != NULL && finish_journal())
+				fprintf(stderr, _("\nUnsaved edits of %s are in %s\n"),
+								openfile->filename, openfile->journal->filename);
+			else
+#endif
 			emergency_save(openfile->filename, openfile->current_stat);
 		}
 
@@ -800,6 +1948,9 @@ void usage(void)
 	print_opt("-d", "--rebinddelete",
 					N_("Fix Backspace/Delete confusion problem"));
 	print_opt("-e", "--emptyline", N_("Keep the line below the title bar empty"));
+#ifndef NANO_TINY
+	print_opt("-f", "--follow", N_("Keep adding what gets appended to the files"));
+#endif
 #ifdef ENABLE_BROWSER
 	if (!ISSET(RESTRICTED))
 		print_opt("-g", "--showcursor", N_("Show cursor in file browser & help text"));
@@ -849,6 +2000,7 @@ void usage(void)
 		print_opt("-z", "--suspend", N_("Enable suspension"));
 #ifndef NANO_TINY
 	print_opt("-$", "--softwrap", N_("Enable soft line wrapping"));
+	print_opt("-%", "--memstats", N_("Report the memory use per buffer at exit"));
 #endif
 }
 
@@ -1028,6 +2180,9 @@ void close_and_go(void)
 	/* If there is a lockfile, remove it. */
 	if (ISSET(LOCKING) && openfile->lock_filename)
 		delete_lockfile(openfile->lock_filename);
+	/* The unsaved edits are being abandoned, so forget about them. */
+	if (openfile->journal != NULL)
+		drop_journal(openfile);
 #endif
 #ifdef ENABLE_MULTIBUFFER
 	/* If there is another buffer, close this one; otherwise terminate. */
@@ -1036,6 +2191,10 @@ void close_and_go(void)
 		if (ISSET(POSITIONLOG))
 			update_poshistory(openfile->filename,
 							openfile->current->lineno, xplustabs() + 1);
+#endif
+#ifndef NANO_TINY
+		if (ISSET(MEMORY_STATS))
+			report_buffer(openfile);
 #endif
 		switch_to_next_buffer();
 		openfile = openfile->prev;
@@ -1117,9 +2276,9 @@ bool scoop_stdin(void)
 	/* Set up a signal handler so that ^C will stop the reading. */
 	install_handler_for_Ctrl_C();
 
-	/* Read the input into a new buffer. */
+	/* Read the input into a new buffer -- from a pipe, in the background. */
 	make_new_buffer();
-	read_file(stream, 0, "stdin", TRUE);
+	read_file(stream, 0, "stdin", FALSE);
 #ifdef ENABLE_COLOR
 	color_update();
 #endif
@@ -1619,6 +2778,20 @@ bool wanted_to_move(void (*func)(void))
 			func == to_first_line || func == to_last_line;
 }
 
+#ifndef NANO_TINY
+/* Return TRUE when the given function edits or looks at only the lines
+ * around the cursor, so that it can do without right numbers further on. */
+bool stays_nearby(void (*func)(void))
+{
+	return func == do_left || func == do_right ||
+			func == do_up || func == do_down ||
+			func == do_home || func == do_end ||
+			func == do_tab || func == do_enter ||
+			func == do_backspace || func == do_delete ||
+			func == cut_text || func == paste_text;
+}
+#endif
+
 /* Return TRUE when the given shortcut is admissible in view mode. */
 bool okay_for_view(const keystruct *shortcut)
 {
@@ -1647,8 +2820,15 @@ void do_input(void)
 	input = get_kbinput(edit, VISIBLE);
 
 #ifndef NANO_TINY
-	if (input == KEY_WINCH)
+	if (input == KEY_WINCH || input == KEY_FILECHANGE)
+		return;
+
+	/* While a stream is still coming in, ^C stops the reading of it. */
+	if (input == '\x03' && !meta_key && openfile->loader != NULL &&
+						openfile->loader->map == NULL) {
+		end_streaming();
 		return;
+	}
 #endif
 
 #ifdef ENABLE_MOUSE
@@ -1702,9 +2882,17 @@ void do_input(void)
 	if (shortcut || get_key_buffer_len() == 0) {
 		if (puddle != NULL) {
 			/* Insert all bytes in the input buffer into the edit buffer
-			 * at once, filtering out any low control codes. */
+			 * at once, filtering out any low control codes -- but only
+			 * when the file has been read in completely. */
 			puddle[depth] = '\0';
-			do_output(puddle, depth, FALSE);
+#ifndef NANO_TINY
+			defer_numbering = (openfile->mark == NULL);
+			if (await_loading(0))
+#endif
+				do_output(puddle, depth, FALSE);
+#ifndef NANO_TINY
+			defer_numbering = FALSE;
+#endif
 
 			/* Empty the input buffer. */
 			free(puddle);
@@ -1724,6 +2912,12 @@ void do_input(void)
 		return;
 	}
 
+#ifndef NANO_TINY
+	/* Anything that may change the buffer must wait until it is complete. */
+	if (!okay_for_view(shortcut) && !await_loading(0))
+		return;
+#endif
+
 	/* When not cutting or copying text, drop the cutbuffer the next time. */
 	if (shortcut->func != cut_text) {
 #ifndef NANO_TINY
@@ -1759,12 +2953,20 @@ void do_input(void)
 		openfile->mark_x = openfile->current_x;
 		openfile->kind_of_mark = SOFTMARK;
 	}
+
+	/* Only simple edits around the cursor may leave lines unnumbered;
+	 * anything else gets to see the right numbers everywhere. */
+	defer_numbering = (openfile->mark == NULL && stays_nearby(shortcut->func));
+	if (!defer_numbering)
+		renumber_the_rest();
 #endif
 
 	/* Execute the function of the shortcut. */
 	shortcut->func();
 
 #ifndef NANO_TINY
+	defer_numbering = FALSE;
+
 	/* When the marked region changes without Shift being held,
 	 * discard a soft mark.  And when the marked region covers a
 	 * different set of lines, reset  the "last line too" flag. */
@@ -1795,7 +2997,7 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 {
 	char onechar[MAXCHARLEN];
 	int charlen;
-	size_t current_len = strlen(openfile->current->data);
+	size_t current_len, current_chars;
 	size_t i = 0;
 #ifndef NANO_TINY
 	size_t original_row = 0, old_amount = 0;
@@ -1821,15 +3023,18 @@ void do_output(char *output, size_t output_len, bool allow_cntrls)
 		if (!allow_cntrls && is_ascii_cntrl_char(*(output + i - charlen)))
 			continue;
 
+		current_len = line_length(openfile->current);
+		current_chars = line_chars(openfile->current);
+
 		/* Make room for the new character and copy it into the line. */
-		openfile->current->data = charealloc(openfile->current->data,
+		resize_data(openfile->current,
 										current_len + charlen + 1);
 		memmove(openfile->current->data + openfile->current_x + charlen,
 						openfile->current->data + openfile->current_x,
 						current_len - openfile->current_x + 1);
 		strncpy(openfile->current->data + openfile->current_x, onechar,
 						charlen);
-		current_len += charlen;
+		set_counts(openfile->current, current_len + charlen, current_chars + 1);
 		openfile->totsize++;
 		set_modified();
 
@@ -1915,6 +3120,10 @@ int main(int argc, char **argv)
 #ifdef ENABLE_JUSTIFY
 	int quoterc;
 		/* Whether the quoting regex was compiled successfully. */
+#endif
+#ifndef NANO_TINY
+	bool follow_them = FALSE;
+		/* Whether to follow the growth of the files that get opened. */
 #endif
 	const struct option long_options[] = {
 		{"boldtext", 0, NULL, 'D'},
@@ -1990,11 +3199,13 @@ int main(int argc, char **argv)
 		{"wordchars", 1, NULL, 'X'},
 		{"zap", 0, NULL, 'Z'},
 		{"atblanks", 0, NULL, 'a'},
+		{"follow", 0, NULL, 'f'},
 		{"autoindent", 0, NULL, 'i'},
 		{"cutfromcursor", 0, NULL, 'k'},
 		{"unix", 0, NULL, 'u'},
 		{"afterends", 0, NULL, 'y'},
 		{"softwrap", 0, NULL, '$'},
+		{"memstats", 0, NULL, '%'},
 #endif
 		{NULL, 0, NULL, 0}
 	};
@@ -2039,6 +3250,10 @@ int main(int argc, char **argv)
 						" -- please report a bug\n", (int)MB_CUR_MAX);
 #endif
 
+	/* Pick the fastest way of finding line breaks, before any thread
+	 * that reads a file can start. */
+	choose_break_finder();
+
 	/* Set sensible defaults, different from what Pico does. */
 	SET(NO_WRAP);
 	SET(SMOOTH_SCROLL);
@@ -2052,7 +3267,7 @@ int main(int argc, char **argv)
 
 	while ((optchr =
 		getopt_long(argc, argv,
-				"ABC:DEFGHIJ:KLMNOPQ:RST:UVWX:Y:Zabcdeghijklmno:pr:s:tuvwxyz$",
+				"ABC:DEFGHIJ:KLMNOPQ:RST:UVWX:Y:Zabcdefghijklmno:pr:s:tuvwxyz$%",
 				long_options, NULL)) != -1) {
 		switch (optchr) {
 #ifndef NANO_TINY
@@ -2192,6 +3407,11 @@ int main(int argc, char **argv)
 			case 'e':
 				SET(EMPTY_LINE);
 				break;
+#ifndef NANO_TINY
+			case 'f':
+				follow_them = TRUE;
+				break;
+#endif
 			case 'g':
 				SET(SHOW_CURSOR);
 				break;
@@ -2280,6 +3500,9 @@ int main(int argc, char **argv)
 			case '$':
 				SET(SOFTWRAP);
 				break;
+			case '%':
+				SET(MEMORY_STATS);
+				break;
 #endif
 			default:
 				printf(_("Type '%s -h' for a list of available options.\n"), argv[0]);
@@ -2584,6 +3807,12 @@ int main(int argc, char **argv)
 	set_escdelay(50);
 #endif
 
+#if defined(ENABLE_MULTIBUFFER) && !defined(NANO_TINY)
+	/* When several files are to be opened, let helpers read them ahead. */
+	if (argc - optind > 1 && !ISSET(NOREAD_MODE))
+		start_prefetching(argv + optind, argc - optind);
+#endif
+
 	/* Read the files mentioned on the command line into new buffers. */
 	while (optind < argc && (!openfile || read_them_all)) {
 		ssize_t givenline = 0, givencol = 0;
@@ -2630,6 +3859,11 @@ int main(int argc, char **argv)
 		} else if (!open_buffer(argv[optind++], TRUE))
 			continue;
 
+#ifndef NANO_TINY
+		if (follow_them)
+			start_following();
+#endif
+
 		/* If a position was given on the command line, go there. */
 		if (givenline != 0 || givencol != 0)
 			do_gotolinecolumn(givenline, givencol, FALSE, FALSE);
@@ -2660,6 +3894,11 @@ int main(int argc, char **argv)
 #endif
 	}
 
+#if defined(ENABLE_MULTIBUFFER) && !defined(NANO_TINY)
+	if (prefetch != NULL)
+		stop_prefetching();
+#endif
+
 	/* If no filenames were given, or all of them were invalid things like
 	 * directories, then open a blank buffer and allow editing.  Otherwise,
 	 * switch from the last opened file to the next, that is: the first. */
@@ -2691,13 +3930,31 @@ int main(int argc, char **argv)
 
 #ifdef ENABLE_HELP
 	if (*openfile->filename == '\0' && openfile->totsize == 0 &&
+#ifndef NANO_TINY
+				openfile->loader == NULL &&
+#endif
 				openfile->next == openfile && !ISSET(NO_HELP))
 		statusbar(_("Welcome to nano.  For basic help, type Ctrl+G."));
 #endif
 
 	while (TRUE) {
+#ifndef NANO_TINY
+		/* When only part of the file is in memory, keep the cursor amidst it. */
+		if (openfile->window != NULL)
+			keep_window_around_cursor();
+
+		/* Give the lines that will be shown their right numbers. */
+		renumber_ahead();
+#endif
 #ifdef ENABLE_LINENUMBERS
 		confirm_margin();
+#endif
+#ifndef NANO_TINY
+		/* Tell (once) about what happened to the file on disk. */
+		if (openfile->disk_change != openfile->reported_change) {
+			renumber_the_rest();
+			report_change_on_disk();
+		}
 #endif
 		if (currmenu != MMAIN)
 			bottombars(MMAIN);
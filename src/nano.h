@@ -113,6 +113,16 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#ifndef NANO_TINY
+#include <pthread.h>
+#endif
+
+/* When zlib is available, gzipped files are decompressed when read. */
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ) && !defined(NANO_TINY)
+#define USE_ZLIB yes
+#include <zlib.h>
+#endif
 
 /* If we aren't using an ncurses with mouse support, exclude any
  * mouse routines, as they are useless then. */
@@ -162,6 +172,10 @@ typedef enum {
 	CENTERING, FLOWING, STATIONARY
 } update_type;
 
+typedef enum {
+	SAME_ON_DISK, GROWN_ON_DISK, CHANGED_ON_DISK, GONE_FROM_DISK
+} disk_change_type;
+
 /* The kinds of undo actions.  ADD...REPLACE must come first. */
 typedef enum {
 	ADD, ENTER, BACK, DEL, JOIN, REPLACE,
@@ -291,9 +305,178 @@ typedef struct linestruct {
 	short *multidata;
 		/* Array of which multi-line regexes apply to this line. */
 #endif
+	unsigned int length;
+		/* The number of bytes in the text, or UNCOUNTED when not known. */
+	unsigned int chars;
+		/* The number of characters in the text, when its length is known. */
 } linestruct;
 
+/* The value of the length of a line that has not been counted (yet). */
+#define UNCOUNTED  ((unsigned int)-1)
+
+/* The text of a line that is not longer than this (including the final NUL)
+ * is stored right behind the node of the line, in the same allocation. */
+#define INLINELIMIT 48
+#define INLINE_DATA(line)  ((char *)((line) + 1))
+
+#ifndef NANO_TINY
+/* The line index of a buffer holds every so many-th line. */
+#define INDEXSTRIDE 64
+
+typedef struct blockstruct {
+	struct blockstruct *next;
+		/* The next block of the same arena. */
+	size_t size;
+		/* The size of this block, including this header. */
+} blockstruct;
+
+typedef struct arenastruct {
+	char *spot;
+		/* Where the next piece will be carved out of the current block. */
+	size_t room;
+		/* How many bytes are still free in the current block. */
+	blockstruct *blocks;
+		/* The registered blocks, whose pieces get recognized as such. */
+	blockstruct *fresh;
+		/* The blocks that were added since the last registration. */
+	bool pristine;
+		/* Whether the lines are unchanged since they were carved out. */
+} arenastruct;
+#endif
+
+typedef struct splitstruct {
+	linestruct *topline;
+		/* The first of the lines that were split off so far. */
+	linestruct *bottomline;
+		/* The line that will receive the next piece of text. */
+	size_t num_lines;
+		/* The number of completed lines. */
 #ifndef NANO_TINY
+	int format;
+		/* 0 = *nix, 1 = DOS, 2 = Mac, 3 = both DOS and Mac. */
+	arenastruct *arena;
+		/* Where the lines get carved from, or NULL for the heap. */
+	bool in_place;
+		/* Whether the lines may keep their text where it is, instead of
+		 * getting a copy: when the text was read into a block of the arena. */
+#endif
+} splitstruct;
+
+#ifndef NANO_TINY
+typedef struct loaderstruct {
+	int fd;
+		/* The file or stream that is being read. */
+	char *map;
+		/* The block of the buffer's arena that the file is read into,
+		 * and where its lines keep their text -- NULL for a stream. */
+	size_t size;
+		/* The size of the file and of that block. */
+	size_t got;
+		/* How many bytes of the file have been read. */
+	size_t done;
+		/* How many bytes of the file have been split into lines. */
+	splitstruct split;
+		/* The lines that the worker has split off but not yet handed over. */
+	bool writable;
+		/* Whether the file is writable (to be reported at the end). */
+	bool threaded;
+		/* Whether the worker actually runs in a thread of its own. */
+	pthread_t thread;
+		/* The thread that does the reading. */
+	pthread_mutex_t lock;
+		/* Guards the fields below, which are shared between the threads. */
+	pthread_cond_t arrival;
+		/* Signalled whenever a batch of lines has been handed over. */
+	linestruct *readytop;
+		/* The first of the lines that are ready to be taken in. */
+	linestruct *readybot;
+		/* The last of the lines that are ready to be taken in. */
+	blockstruct *readyblocks;
+		/* The blocks of the worker's arena that came along with these lines. */
+	bool finished;
+		/* Whether the worker has reached the end of the file. */
+	bool stop;
+		/* Whether the worker should give up. */
+} loaderstruct;
+
+typedef struct fetchstruct {
+	char *filename;
+		/* The name of the file to be read, or NULL once it was dealt with. */
+	struct stat fileinfo;
+		/* The identity and state of the file when it was read. */
+	splitstruct split;
+		/* The lines that were read from the file. */
+	bool claimed;
+		/* Whether a helper (or the main thread itself) took up the reading. */
+	bool ready;
+		/* Whether the reading is done -- split.topline is NULL when it failed. */
+} fetchstruct;
+
+typedef struct prefetchstruct {
+	fetchstruct *files;
+		/* The files that are to be read ahead, in the order of opening. */
+	size_t count;
+		/* The number of files. */
+	size_t next;
+		/* The first file that nobody has claimed yet. */
+	pthread_t *threads;
+		/* The helpers that read the files. */
+	int threadcount;
+		/* The number of helpers. */
+	pthread_mutex_t lock;
+		/* Guards the claimed and ready fields and the next index. */
+	pthread_cond_t done;
+		/* Signalled whenever a helper has finished reading a file. */
+} prefetchstruct;
+
+typedef struct windowstruct {
+	char *map;
+		/* The read-only memory mapping of the whole file. */
+	size_t size;
+		/* The size of the file and of its mapping. */
+	size_t startbyte;
+		/* Where in the file the first line in memory begins. */
+	size_t endbyte;
+		/* Where in the file the text after the last line in memory begins. */
+	ssize_t topline;
+		/* The number of the first line in memory. */
+	ssize_t bottomline;
+		/* The number that the last line in memory has in the file. */
+	int format;
+		/* The format of the file, as far as it has been seen. */
+	format_type filefmt;
+		/* The format that the first line break of the file indicates. */
+	dev_t device;
+		/* The device that the mapped file lives on. */
+	ino_t inode;
+		/* The inode number of the mapped file. */
+	bool also_cr;
+		/* Whether a lone carriage return ends a line. */
+	size_t *checkpoints;
+		/* Where in the file every CHECKSTEP-th line begins, for as far as known. */
+	size_t checkcount;
+		/* The number of known checkpoints. */
+	ssize_t lastline;
+		/* The number of lines in the file, or zero while not yet known. */
+	linestruct *dropped;
+		/* The lines that left memory, to be freed before the next command. */
+} windowstruct;
+
+typedef struct followstruct {
+	int fd;
+		/* The descriptor through which the followed file is read. */
+	int watch;
+		/* The inotify instance that watches the file, or -1 when polling. */
+	bool anchored;
+		/* Whether it is known where in the file the buffer's last line begins. */
+	off_t size;
+		/* How much of the file the buffer holds. */
+	off_t linestart;
+		/* Where in the file the last, possibly incomplete line begins. */
+	linestruct *uncolored;
+		/* The first line whose multiline coloring is not up to date. */
+} followstruct;
+
 typedef struct groupstruct {
 	ssize_t top_line;
 		/* First line of group. */
@@ -331,6 +514,91 @@ typedef struct undostruct {
 	struct undostruct *next;
 		/* A pointer to the undo item of the preceding action. */
 } undostruct;
+
+typedef struct journalstruct {
+	char *filename;
+		/* The name of the journal file. */
+	int fd;
+		/* The descriptor of the journal file, or -1 when not yet created. */
+	struct stat base;
+		/* The state of the edited file that the journal starts from. */
+	bool exists;
+		/* Whether the edited file existed when the journal was started. */
+	undostruct *current;
+		/* The undo item at which a replay of the journal ends. */
+	bool amidst;
+		/* Whether an undo or redo was recorded since the last catching up. */
+	undostruct *landing;
+		/* Where the recorded undo or redo will leave the undo stack. */
+	char *pending;
+		/* The records that were not yet written to the journal file. */
+	size_t filled;
+		/* The number of bytes in the above buffer. */
+	size_t room;
+		/* The allocated size of the above buffer. */
+	undostruct *sketched;
+		/* The growing undo item that was last written provisionally. */
+	size_t sketchsize;
+		/* The file size after the action, at the time of that writing. */
+	time_t due;
+		/* When the pending records should be written out, or zero. */
+} journalstruct;
+
+/* The text of an idle buffer gets packed per this many bytes. */
+#define PACKBLOCK 65536
+
+typedef struct packblockstruct {
+	struct packblockstruct *next;
+		/* The next block of packed text. */
+	size_t size;
+		/* The number of bytes of packed text that follow this header. */
+	size_t rawsize;
+		/* The number of bytes of text that they unpack into. */
+} packblockstruct;
+
+typedef struct packstruct {
+	packblockstruct *first;
+		/* The first block of the packed text. */
+	packblockstruct *last;
+		/* The block that was added last. */
+	size_t lines;
+		/* The number of lines whose texts (each ended by a NUL) were packed. */
+	ssize_t current;
+		/* The number of the line where the cursor was. */
+	ssize_t edittop;
+		/* The number of the line at the top of the edit window. */
+	ssize_t mark;
+		/* The number of the line where the mark was, or zero when unset. */
+} packstruct;
+
+typedef struct memstruct {
+	size_t lines;
+		/* The number of lines. */
+	size_t nodes;
+		/* The bytes taken by the nodes of the lines. */
+	size_t text;
+		/* The bytes taken by the texts of the lines, terminators included. */
+	size_t shared;
+		/* The part of those texts that is held also by other lines. */
+	size_t slack;
+		/* The bytes that are allocated for the lines but hold nothing. */
+	size_t colors;
+		/* The bytes of the multiline coloring info of the lines. */
+	size_t index;
+		/* The bytes of the line index and the character sums. */
+	size_t packed;
+		/* The bytes of the compressed text of an idle buffer. */
+	size_t items;
+		/* The number of undo items. */
+	size_t undo;
+		/* The bytes taken by the undo items themselves. */
+	size_t undotext;
+		/* The bytes of the texts that the undo items hold. */
+	size_t undolines;
+		/* The bytes of the lines (nodes and texts) that undo items hold. */
+	size_t grouping;
+		/* The bytes of the indentations that undo items hold. */
+} memstruct;
 #endif /* !NANO_TINY */
 
 #ifdef ENABLE_HISTORIES
@@ -393,6 +661,50 @@ typedef struct openfilestruct {
 		/* The undo item at which the file was last saved. */
 	undo_type last_action;
 		/* The type of the last action the user performed. */
+	linestruct **lineindex;
+		/* Every INDEXSTRIDE-th line, starting with the first, for finding
+		 * a line by its number without walking the whole list. */
+	size_t indexed;
+		/* The number of entries of the index that are valid. */
+	size_t indexroom;
+		/* The number of entries that the index has room for. */
+	size_t *stridechars;
+		/* The number of characters (newlines included) in each stride of
+		 * lines that starts at an entry of the line index. */
+	size_t *charsums;
+		/* Those same numbers, accumulated as a Fenwick tree: element i
+		 * holds the strides from i - (i & -i) up to i (counting from 1). */
+	size_t summed;
+		/* The number of strides at the top whose characters are counted. */
+	ssize_t stale;
+		/* A counted stride whose text has changed since, or -1 when none. */
+	linestruct *unnumbered;
+		/* The first line whose number lags behind, or NULL when none does. */
+	ssize_t lag;
+		/* What that line and the ones after it (except the last line of
+		 * the buffer, which is always right) must add to their number. */
+	arenastruct *arena;
+		/* Where the lines of the file were carved from, if anywhere. */
+	loaderstruct *loader;
+		/* The background reader of the file, while it is still busy. */
+	windowstruct *window;
+		/* The part of a huge file that is in memory, when not all of it is. */
+	followstruct *follower;
+		/* The watcher of the file's growth, when the file is being followed. */
+	journalstruct *journal;
+		/* The record of the edits since the file was last saved, if any. */
+	packstruct *packed;
+		/* The compressed text of the buffer while it is idle, else NULL. */
+	time_t visited;
+		/* When the buffer was last seen being the current one. */
+	bool gzipped;
+		/* Whether the file was read from gzipped data, and gets saved so. */
+	int watch;
+		/* The inotify watch on the file, or -1 when it is not watched. */
+	disk_change_type disk_change;
+		/* What happened to the file on disk since it was read or saved. */
+	disk_change_type reported_change;
+		/* The change of the file on disk that the user was told about. */
 #endif
 	bool modified;
 		/* Whether the file has been modified. */
@@ -537,7 +849,10 @@ enum
 	LET_THEM_ZAP,
 	BREAK_LONG_LINES,
 	JUMPY_SCROLLING,
-	EMPTY_LINE
+	EMPTY_LINE,
+	ATOMIC_SAVE,
+	JOURNAL,
+	MEMORY_STATS
 };
 
 /* Flags for the menus in which a given function should be present. */
@@ -623,12 +938,16 @@ enum
 /* An imaginary key for when we get a SIGWINCH (window resize). */
 #define KEY_WINCH -2
 
+/* An imaginary key for when the file of the current buffer changed on disk. */
+#define KEY_FILECHANGE -3
+
 /* Some extra flags for the undo function. */
 #define WAS_FINAL_BACKSPACE   (1<<1)
 #define WAS_WHOLE_LINE        (1<<2)
 #define WAS_FINAL_LINE        (1<<3)
 #define MARK_WAS_SET          (1<<4)
 #define WAS_MARKED_FORWARD    (1<<5)
+#define WAS_JOURNALED         (1<<6)
 #endif /* !NANO_TINY */
 
 /* The default number of columns from end of line where wrapping occurs. */
@@ -649,3 +968,8 @@ enum
 
 /* The largest size_t number that doesn't have the high bit set. */
 #define HIGHEST_POSITIVE ((~(size_t)0) >> 1)
+
+/* For a file that is windowed: every how many lines the position of a line
+ * is recorded, and the position that stands for "beyond the end". */
+#define CHECKSTEP 1024
+#define NOWHERE ((size_t)-1)
@@ -37,6 +37,14 @@ extern bool as_an_at;
 
 extern bool control_C_was_pressed;
 
+#ifndef NANO_TINY
+extern int files_loading;
+extern int files_followed;
+extern int watcher;
+extern prefetchstruct *prefetch;
+extern bool replaying_journal;
+#endif
+
 extern bool suppress_cursorpos;
 
 extern bool started_curses;
@@ -93,6 +101,9 @@ extern int margin;
 #ifndef NANO_TINY
 extern ssize_t stripe_column;
 #endif
+#if defined(ENABLE_MULTIBUFFER) && !defined(NANO_TINY)
+extern ssize_t compress_after;
+#endif
 
 extern linestruct *cutbuffer;
 extern linestruct *cutbottom;
@@ -128,6 +139,7 @@ extern ssize_t tabsize;
 extern char *backup_dir;
 extern const char *locking_prefix;
 extern const char *locking_suffix;
+extern const char *journal_suffix;
 #endif
 #ifdef ENABLE_OPERATINGDIR
 extern char *operating_dir;
@@ -216,6 +228,7 @@ int mbwidth(const char *c);
 char *make_mbchar(long chr, int *chr_mb_len);
 int char_length(const char *pointer);
 size_t mbstrlen(const char *s);
+size_t mbstrnlen(const char *s, size_t maxlen);
 int parse_mbchar(const char *buf, char *chr, size_t *col);
 size_t step_left(const char *buf, size_t pos);
 size_t step_right(const char *buf, size_t pos);
@@ -247,7 +260,9 @@ void color_init(void);
 void color_update(void);
 void set_up_multicache(linestruct *line);
 void check_the_multis(linestruct *line);
+void discard_multicolorinfo(linestruct *line);
 void precalc_multicolorinfo(void);
+void precalc_multicolorinfo_from(linestruct *first);
 #endif
 
 /* Most functions in cut.c. */
@@ -257,6 +272,7 @@ void do_backspace(void);
 void chop_previous_word(void);
 void chop_next_word(void);
 void cut_marked(bool *right_side_up);
+void copy_piece(bool *right_side_up);
 #endif
 void do_snip(bool copying, bool marked, bool until_eof, bool append);
 bool is_cuttable(bool test_cliff);
@@ -271,6 +287,32 @@ void paste_text(void);
 /* Most functions in files.c. */
 void make_new_buffer(void);
 void set_modified(void);
+#ifndef NANO_TINY
+char *journal_name(const char *filename);
+void start_journal(openfilestruct *buffer);
+void drop_journal(openfilestruct *buffer);
+void journal_bytes(journalstruct *journal, const void *bytes, size_t count);
+void journal_number(journalstruct *journal, long long number);
+void journal_text(journalstruct *journal, const char *text, size_t length);
+void journal_mark(journalstruct *journal, char kind);
+void journal_item(journalstruct *journal, char kind, undostruct *u, bool as_redo);
+void journal_the_stack(bool all);
+undostruct *bottom_of_group(undostruct *u);
+void journal_the_undo(bool redoing);
+bool write_journal(openfilestruct *buffer);
+bool tend_journals(void);
+bool finish_journal(void);
+bool take_number(const char **at, const char *end, long long *number);
+bool take_text(const char **at, const char *end, char **text);
+undostruct *item_from_record(const char *at, const char *end);
+bool opens_group(undostruct *u);
+bool bounds_group(undostruct *u);
+bool bring_in_item(undostruct *u);
+bool bring_in_undo(bool redoing);
+bool replay_item(undostruct *item, undostruct **base);
+size_t replay_journal(const char *data, size_t size);
+void recover_journal(void);
+#endif
 bool open_buffer(const char *filename, bool new_buffer);
 #ifdef ENABLE_SPELLER
 bool replace_buffer(const char *filename, undo_type action, bool marked,
@@ -282,7 +324,85 @@ void mention_name_and_linecount(void);
 void switch_to_prev_buffer(void);
 void switch_to_next_buffer(void);
 void close_buffer(void);
+#ifndef NANO_TINY
+void pack_buffer(openfilestruct *buffer);
+void unpack_buffer(void);
+bool pack_idle_buffers(void);
 #endif
+#endif
+char *encode_data(splitstruct *split, const char *text, size_t length);
+char *line_data(splitstruct *split, const char *text, size_t length);
+void store_line(splitstruct *split, const char *text, size_t length);
+linestruct *make_split_node(splitstruct *split, linestruct *prevnode);
+size_t split_into_lines(splitstruct *split, const char *text, size_t size,
+		bool at_end);
+#ifndef NANO_TINY
+int read_in_place(int fd, splitstruct *split, size_t size);
+#endif
+int slurp_into_lines(FILE *f, splitstruct *split);
+#ifdef USE_ZLIB
+bool is_gzipped(int fd);
+int inflate_into_lines(FILE *f, splitstruct *split);
+#endif
+#ifndef NANO_TINY
+void hand_over_lines(loaderstruct *loader, bool finished);
+void *load_the_rest(void *the_loader);
+void *stream_the_rest(void *the_loader);
+loaderstruct *begin_loading(FILE *f, splitstruct *split);
+loaderstruct *begin_streaming(FILE *f, splitstruct *split);
+void release_source(loaderstruct *loader);
+bool same_file_state(const struct stat *one, const struct stat *other);
+void *prefetch_files(void *dummy);
+void start_prefetching(char **names, int count);
+bool take_prefetched(const char *filename, FILE *f, splitstruct *split);
+void stop_prefetching(void);
+void start_loading(loaderstruct *loader);
+void finish_loading(openfilestruct *buffer);
+void take_in_lines(openfilestruct *buffer);
+void take_in_all_lines(void);
+void wait_for_lines(openfilestruct *buffer);
+bool await_loading(ssize_t lineno);
+void end_streaming(void);
+void stop_loading(openfilestruct *buffer);
+windowstruct *open_window(FILE *f);
+void close_window(windowstruct *window);
+size_t next_line_start(windowstruct *window, size_t pos);
+size_t line_start(windowstruct *window, ssize_t lineno);
+ssize_t last_line_number(windowstruct *window);
+ssize_t window_shift(windowstruct *window);
+ssize_t windowed_linecount(windowstruct *window);
+size_t windowed_textlines(windowstruct *window);
+linestruct *page_in(windowstruct *window, size_t start, size_t end,
+		ssize_t lineno, linestruct **bottom);
+void drop_lines(windowstruct *window, linestruct *top, linestruct *bottom);
+bool fill_window(ssize_t top, ssize_t bottom);
+bool grow_window_up(ssize_t top);
+bool grow_window_down(ssize_t bottom);
+void shrink_window_top(ssize_t top);
+void shrink_window_bottom(ssize_t bottom);
+linestruct *move_window_to(ssize_t lineno);
+void keep_window_around_cursor(void);
+bool bring_in_line(ssize_t lineno);
+void start_window(windowstruct *window);
+bool write_untouched(windowstruct *window, FILE *stream, bool above);
+bool rebase_window(windowstruct *window, const char *filename);
+void start_following(void);
+void stop_following(openfilestruct *buffer);
+void anchor_follower(openfilestruct *buffer);
+bool extend_window(windowstruct *window, int fd, size_t size);
+void append_growth(openfilestruct *buffer, const char *text, size_t length);
+void take_in_growth(openfilestruct *buffer);
+void take_in_all_growth(void);
+void do_follow(void);
+void watch_file(openfilestruct *buffer);
+void unwatch_file(openfilestruct *buffer);
+bool await_input(int delay);
+void examine_file(openfilestruct *buffer);
+bool spot_changes(void);
+void take_in_additions(void);
+void report_change_on_disk(void);
+#endif
+void report_lines_read(size_t num_lines, int format);
 void read_file(FILE *f, int fd, const char *filename, bool undoable);
 int open_file(const char *filename, bool newfie, FILE **f);
 char *get_next_filename(const char *name, const char *suffix);
@@ -298,7 +418,20 @@ void init_backup_dir(void);
 int delete_lockfile(const char *lockfilename);
 int write_lockfile(const char *lockfilename, const char *origfilename, bool modified);
 #endif
+#ifndef NANO_TINY
+bool offload_copy(FILE *inn, FILE *out);
+#endif
 int copy_file(FILE *inn, FILE *out, bool close_out);
+bool write_pieces(int fd, struct iovec *pieces, int count);
+#ifdef USE_ZLIB
+bool write_packed(gzFile packer, struct iovec *pieces, int count);
+#endif
+ssize_t write_lines(FILE *stream, linestruct *line, bool more_follows,
+		bool gzipping);
+#ifndef NANO_TINY
+int make_stagefile(const char *filename, const struct stat *st,
+		char **stagename, char **targetname);
+#endif
 bool write_file(const char *name, FILE *f_open, bool tmp,
 		kind_of_writing_type method, bool fullbuffer);
 #ifndef NANO_TINY
@@ -361,6 +494,9 @@ void save_history(void);
 void load_poshistory(void);
 void update_poshistory(char *filename, ssize_t lineno, ssize_t xpos);
 bool has_old_position(const char *file, ssize_t *line, ssize_t *column);
+#ifndef NANO_TINY
+size_t position_history_size(void);
+#endif
 #endif
 
 /* Most functions in move.c. */
@@ -392,17 +528,78 @@ void do_left(void);
 void do_right(void);
 
 /* Most functions in nano.c. */
+linestruct *set_up_node(linestruct *newnode, linestruct *prevnode);
 linestruct *make_new_node(linestruct *prevnode);
+linestruct *make_sized_node(linestruct *prevnode, size_t size);
+linestruct *make_text_node(linestruct *prevnode, const char *text);
 void splice_node(linestruct *afterthis, linestruct *newnode);
 void unlink_node(linestruct *fileptr);
 void delete_node(linestruct *fileptr);
-linestruct *copy_buffer(const linestruct *src);
+linestruct *copy_node(linestruct *src);
+linestruct *copy_buffer(linestruct *src);
 void free_lines(linestruct *src);
+void free_data(char *data);
+void set_data(linestruct *line, char *data);
+char *detach_data(linestruct *line);
+void resize_data(linestruct *line, size_t size);
+void unshare_data(linestruct *line);
+void store_counts(linestruct *line, size_t length, size_t chars);
+void set_counts(linestruct *line, size_t length, size_t chars);
+void forget_counts(linestruct *line);
+size_t line_length(linestruct *line);
+size_t line_chars(linestruct *line);
+#ifndef NANO_TINY
+size_t chunk_home(size_t start);
+size_t chunk_slot(size_t start);
+void add_chunk(size_t start, arenastruct *arena);
+void remove_chunk(size_t start);
+arenastruct *arena_of(const void *piece);
+arenastruct *make_arena(void);
+void *carve(arenastruct *arena, size_t size, bool aligned);
+void adopt_blocks(arenastruct *arena, blockstruct **list);
+void free_arena(arenastruct *arena);
+linestruct *make_arena_node(arenastruct *arena, linestruct *prevnode);
+linestruct *lift_from_arena(linestruct *list, const arenastruct *arena);
+void free_arena_lines(openfilestruct *buffer);
+size_t text_home(const char *text);
+size_t text_slot(const char *text);
+bool is_shared(const char *text);
+void add_sharer(const char *text);
+bool drop_sharer(const char *text);
+char *share_data(linestruct *line);
+size_t allocated_size(void *piece, size_t wanted);
+size_t arena_size(const arenastruct *arena);
+size_t tally_lines(linestruct *line, size_t multis, const arenastruct *arena,
+		memstruct *tally, size_t *carved);
+void tally_buffer(openfilestruct *buffer, memstruct *tally);
+size_t tally_total(const memstruct *tally);
+void tally_the_rest(size_t *cut, size_t *history);
+void do_memstats(void);
+void jot_report(const char *format, ...);
+void report_item(int depth, const char *label, size_t number);
+void report_buffer(openfilestruct *buffer);
+void report_memstats(void);
+#endif
 void renumber_from(linestruct *line);
+void renumber_span(linestruct *first, linestruct *last);
+#ifndef NANO_TINY
+void renumber_ahead(void);
+void renumber_the_rest(void);
+#endif
 void partition_buffer(linestruct *top, size_t top_x,
 		linestruct *bot, size_t bot_x);
 void unpartition_buffer(void);
+void add_to_cutbuffer(linestruct *head, linestruct *tail);
+#ifndef NANO_TINY
+void extract_lines(linestruct *top, linestruct *bot);
+#endif
 void extract(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x);
+#ifndef NANO_TINY
+void copy_region(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x);
+#endif
+#ifndef NANO_TINY
+void ingraft_lines(linestruct *topline, linestruct *bottomline, size_t size);
+#endif
 void ingraft_buffer(linestruct *somebuffer);
 void copy_from_buffer(linestruct *somebuffer);
 void print_view_warning(void);
@@ -480,9 +677,24 @@ void parse_rcfile(FILE *rcstream, bool just_syntax, bool intros_only);
 void do_rcfiles(void);
 #endif /* ENABLE_NANORC */
 
+/* Most functions in scan.c. */
+const char *find_break_scalar(const char *head, const char *tail, bool also_cr);
+#if defined(__GNUC__) && defined(__x86_64__)
+const char *find_break_sse2(const char *head, const char *tail, bool also_cr);
+const char *find_break_avx2(const char *head, const char *tail, bool also_cr);
+#endif
+void choose_break_finder(void);
+const char *find_break(const char *head, const char *tail, bool also_cr);
+
 /* Most functions in search.c. */
 bool regexp_init(const char *regexp);
 void tidy_up_after_search(void);
+#ifndef NANO_TINY
+ssize_t search_stretch(const char *needle, bool whole_word_only,
+		ssize_t first, ssize_t last, size_t *x);
+linestruct *search_outside_window(const char *needle, bool whole_word_only,
+		bool report_wrap, const char **found);
+#endif
 int findnextstr(const char *needle, bool whole_word_only, int modus,
 		size_t *match_len, bool skipone, const linestruct *begin, size_t begin_x);
 void do_search(void);
@@ -496,6 +708,7 @@ ssize_t do_replace_loop(const char *needle, bool whole_word_only,
 		const linestruct *real_current, size_t *real_current_x);
 void do_replace(void);
 void ask_for_replacement(void);
+void go_to_line(ssize_t line);
 void goto_line_posx(ssize_t line, size_t pos_x);
 void do_gotolinecolumn(ssize_t line, ssize_t column, bool use_answer,
 		bool interactive);
@@ -522,6 +735,7 @@ void do_enter(void);
 #ifndef NANO_TINY
 RETSIGTYPE cancel_command(int signal);
 bool execute_command(const char *command);
+void free_undo_item(undostruct *item);
 void discard_until(const undostruct *thisitem, openfilestruct *thefile, bool keep);
 void add_undo(undo_type action, const char *message);
 void update_multiline_undo(ssize_t lineno, char *indentation);
@@ -596,9 +810,23 @@ void get_region(const linestruct **top, size_t *top_x,
 		const linestruct **bot, size_t *bot_x, bool *right_side_up);
 void get_range(const linestruct **top, const linestruct **bot);
 #endif
-size_t get_totsize(const linestruct *begin, const linestruct *end);
+size_t get_totsize(linestruct *begin, linestruct *end);
+size_t region_size(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x);
 #ifndef NANO_TINY
+bool extend_index(size_t entry);
+void forget_sums_from(openfilestruct *buffer, size_t stride);
+void forget_index_from(const linestruct *bottom, ssize_t number);
+void unindex_line(const linestruct *line);
+linestruct *indexed_line(ssize_t number);
 linestruct *line_from_number(ssize_t lineno);
+void mark_stride(const linestruct *line);
+size_t count_stride(size_t stride);
+void add_to_sums(size_t stride, ssize_t amount);
+size_t chars_before(linestruct *line);
+size_t put_sequence(unsigned char *spot, const char *literals, size_t count,
+		size_t distance, size_t length);
+size_t pack_text(const char *text, size_t size, char *packed);
+void unpack_text(const char *packed, size_t size, char *text);
 #endif
 
 /* Most functions in winio.c. */
@@ -97,14 +97,20 @@ static const rcoption rcopts[] = {
 	{"afterends", AFTER_ENDS},
 	{"allow_insecure_backup", INSECURE_BACKUP},
 	{"atblanks", AT_BLANKS},
+	{"atomicsave", ATOMIC_SAVE},
 	{"autoindent", AUTOINDENT},
 	{"backup", BACKUP_FILE},
 	{"backupdir", 0},
 	{"casesensitive", CASE_SENSITIVE},
 	{"cutfromcursor", CUT_FROM_CURSOR},
 	{"guidestripe", 0},
+#ifdef ENABLE_MULTIBUFFER
+	{"idlecompress", 0},
+#endif
+	{"journal", JOURNAL},
 	{"locking", LOCKING},
 	{"matchbrackets", 0},
+	{"memstats", MEMORY_STATS},
 	{"noconvert", NO_CONVERT},
 	{"showcursor", SHOW_CURSOR},
 	{"smarthome", SMART_HOME},
@@ -1240,7 +1246,17 @@ void parse_rcfile(FILE *rcstream, bool just_syntax, bool intros_only)
 				stripe_column = 0;
 			}
 			free(argument);
-		} else if (strcasecmp(option, "matchbrackets") == 0) {
+		} else
+#ifdef ENABLE_MULTIBUFFER
+		if (strcasecmp(option, "idlecompress") == 0) {
+			if (!parse_num(argument, &compress_after) || compress_after < 0) {
+				jot_error(N_("Idle time \"%s\" is invalid"), argument);
+				compress_after = 0;
+			}
+			free(argument);
+		} else
+#endif
+		if (strcasecmp(option, "matchbrackets") == 0) {
 			if (has_blank_char(argument)) {
 				jot_error(N_("Non-blank characters required"));
 				free(argument);
@@ -0,0 +1,121 @@
+/**************************************************************************
+ *   scan.c  --  This file is part of GNU nano.                           *
+ *                                                                        *
+ *   Copyright (C) 2019 Free Software Foundation, Inc.                    *
+ *                                                                        *
+ *   GNU nano is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published    *
+ *   by the Free Software Foundation, either version 3 of the License,    *
+ *   or (at your option) any later version.                               *
+ *                                                                        *
+ *   GNU nano is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+/* The routines in this file look for line breaks in a stretch of text.
+ * Apart from find_break(), which uses the finder that main() has chosen
+ * before any thread starts, they use no global state, so that they can
+ * be benchmarked on their own. */
+
+#include "proto.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_VECTORS
+#endif
+
+static const char *(*finder)(const char *, const char *, bool) = NULL;
+		/* The fastest of the routines below that this machine can run. */
+
+/* Return a pointer to the first newline in the text between head and tail --
+ * or, when also_cr is TRUE, to the first newline or carriage return.  Return
+ * NULL when there is none.  This version looks at one byte at a time. */
+const char *find_break_scalar(const char *head, const char *tail, bool also_cr)
+{
+	for (; head < tail; head++)
+		if (*head == '\n' || (also_cr && *head == '\r'))
+			return head;
+
+	return NULL;
+}
+
+#ifdef HAVE_X86_VECTORS
+/* The same, but looking at sixteen bytes at a time. */
+const char *find_break_sse2(const char *head, const char *tail, bool also_cr)
+{
+	__m128i newlines = _mm_set1_epi8('\n');
+	__m128i others = _mm_set1_epi8(also_cr ? '\r' : '\n');
+
+	while (tail - head >= 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)head);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, newlines),
+												_mm_cmpeq_epi8(chunk, others)));
+		if (mask != 0)
+			return head + __builtin_ctz(mask);
+
+		head += 16;
+	}
+
+	for (; head < tail; head++)
+		if (*head == '\n' || (also_cr && *head == '\r'))
+			return head;
+
+	return NULL;
+}
+
+/* The same, but looking at thirty-two bytes at a time. */
+__attribute__((target("avx2")))
+const char *find_break_avx2(const char *head, const char *tail, bool also_cr)
+{
+	__m256i newlines = _mm256_set1_epi8('\n');
+	__m256i others = _mm256_set1_epi8(also_cr ? '\r' : '\n');
+
+	while (tail - head >= 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *)head);
+		unsigned int mask = _mm256_movemask_epi8(
+								_mm256_or_si256(_mm256_cmpeq_epi8(chunk, newlines),
+												_mm256_cmpeq_epi8(chunk, others)));
+		if (mask != 0)
+			return head + __builtin_ctz(mask);
+
+		head += 32;
+	}
+
+	return find_break_sse2(head, tail, also_cr);
+}
+#endif /* HAVE_X86_VECTORS */
+
+/* Determine which of the line-break finders is the best one to use here.
+ * This must be done before any thread can call find_break(). */
+void choose_break_finder(void)
+{
+#ifdef HAVE_X86_VECTORS
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		finder = find_break_avx2;
+	else
+		finder = find_break_sse2;
+#else
+	finder = find_break_scalar;
+#endif
+}
+
+/* Return a pointer to the first newline (or, when also_cr is TRUE, the first
+ * newline or carriage return) between head and tail, or NULL when none. */
+const char *find_break(const char *head, const char *tail, bool also_cr)
+{
+	/* For a single byte value, the C library knows best. */
+	if (!also_cr)
+		return memchr(head, '\n', tail - head);
+
+	return finder(head, tail, also_cr);
+}
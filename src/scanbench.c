@@ -0,0 +1,168 @@
+/**************************************************************************
+ *   scanbench.c  --  This file is part of GNU nano.                      *
+ *                                                                        *
+ *   Copyright (C) 2019 Free Software Foundation, Inc.                    *
+ *                                                                        *
+ *   GNU nano is free software: you can redistribute it and/or modify     *
+ *   it under the terms of the GNU General Public License as published    *
+ *   by the Free Software Foundation, either version 3 of the License,    *
+ *   or (at your option) any later version.                               *
+ *                                                                        *
+ *   GNU nano is distributed in the hope that it will be useful,          *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty          *
+ *   of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.              *
+ *   See the GNU General Public License for more details.                 *
+ *                                                                        *
+ *   You should have received a copy of the GNU General Public License    *
+ *   along with this program.  If not, see http://www.gnu.org/licenses/.  *
+ *                                                                        *
+ **************************************************************************/
+
+/* A small benchmark of the line-break finders in scan.c.  Build it with
+ * "make scanbench" and run it as "./scanbench [FILE]".  Without a file,
+ * it makes up sixty-four megabytes of text with lines of varying lengths. */
+
+#include "proto.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 8
+
+typedef const char *(*finderfunc)(const char *, const char *, bool);
+
+/* Fill a buffer of the given size with lines of pseudo-random lengths,
+ * each ended with the given string. */
+char *make_up_text(size_t size, const char *ending)
+{
+	char *text = malloc(size);
+	unsigned int seed = 12345;
+	size_t filled = 0;
+
+	if (text == NULL)
+		exit(1);
+
+	while (filled < size) {
+		size_t length;
+
+		seed = seed * 1103515245 + 12345;
+		length = (seed >> 16) % 120;
+
+		for (; length > 0 && filled < size; length--, filled++)
+			text[filled] = 'a' + (filled % 26);
+
+		for (const char *end = ending; *end != '\0' && filled < size; end++)
+			text[filled++] = *end;
+	}
+
+	return text;
+}
+
+/* Read the whole of the given file into memory. */
+char *slurp_file(const char *filename, size_t *size)
+{
+	FILE *stream = fopen(filename, "rb");
+	char *text;
+
+	if (stream == NULL || fseek(stream, 0, SEEK_END) != 0) {
+		perror(filename);
+		exit(1);
+	}
+
+	*size = ftell(stream);
+	rewind(stream);
+
+	text = malloc(*size + 1);
+
+	if (text == NULL || fread(text, 1, *size, stream) != *size) {
+		perror(filename);
+		exit(1);
+	}
+
+	fclose(stream);
+
+	return text;
+}
+
+/* Find just newlines, the way the C library does it. */
+const char *find_break_memchr(const char *head, const char *tail, bool also_cr)
+{
+	return memchr(head, '\n', tail - head);
+}
+
+/* Run the given finder over the whole text a few times, and report
+ * how many bytes per second it managed. */
+void measure(const char *name, finderfunc finder, const char *text,
+		size_t size, bool also_cr)
+{
+	const char *tail = text + size;
+	struct timespec start, stop;
+	size_t breaks = 0;
+	double seconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (int round = 0; round < ROUNDS; round++) {
+		const char *head = text;
+
+		while ((head = finder(head, tail, also_cr)) != NULL) {
+			breaks++;
+			head++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("  %-8s %-12s %10zu breaks  %9.1f MB/s\n", name,
+				also_cr ? "LF and CR" : "LF only", breaks / ROUNDS,
+				(double)size * ROUNDS / seconds / 1e6);
+}
+
+/* Measure all available finders on the given text. */
+void measure_all(const char *title, const char *text, size_t size)
+{
+	printf("%s (%zu bytes):\n", title, size);
+
+	for (int pass = 0; pass < 2; pass++) {
+		bool also_cr = (pass == 1);
+
+		measure("scalar", find_break_scalar, text, size, also_cr);
+		if (!also_cr)
+			measure("memchr", find_break_memchr, text, size, also_cr);
+#if defined(__GNUC__) && defined(__x86_64__)
+		measure("sse2", find_break_sse2, text, size, also_cr);
+		if (__builtin_cpu_supports("avx2"))
+			measure("avx2", find_break_avx2, text, size, also_cr);
+#endif
+	}
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = 64 * 1024 * 1024;
+	char *text;
+
+	if (argc > 1) {
+		text = slurp_file(argv[1], &size);
+		measure_all(argv[1], text, size);
+		free(text);
+		return 0;
+	}
+
+	text = make_up_text(size, "\n");
+	measure_all("Unix text", text, size);
+	free(text);
+
+	text = make_up_text(size, "\r\n");
+	measure_all("DOS text", text, size);
+	free(text);
+
+	text = make_up_text(size, "\r");
+	measure_all("Mac text", text, size);
+	free(text);
+
+	return 0;
+}
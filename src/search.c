@@ -166,6 +166,130 @@ void search_init(bool replacing, bool keep_the_answer)
 	free(thedefault);
 }
 
+#ifndef NANO_TINY
+/* Search the lines first to last of the windowed file for the needle, a block
+ * of lines at a time, going upward when searching backward.  Return the number
+ * of the first line that matches, zero when none does, or -1 when cancelled.
+ * Set x to the position of the match in that line.  When whole_word_only is
+ * TRUE, a match counts only when it is a separate word. */
+ssize_t search_stretch(const char *needle, bool whole_word_only,
+		ssize_t first, ssize_t last, size_t *x)
+{
+	windowstruct *window = openfile->window;
+	bool backwards = ISSET(BACKWARDS_SEARCH);
+
+	while (first <= last) {
+		ssize_t top = (backwards && last - first >= CHECKSTEP) ? last - CHECKSTEP + 1 : first;
+		ssize_t bottom = (!backwards && last - first >= CHECKSTEP) ? first + CHECKSTEP - 1 : last;
+		size_t start = line_start(window, top);
+		size_t end = line_start(window, bottom + 1);
+		linestruct *chain, *tail, *line;
+
+		if (start == NOWHERE || (end == NOWHERE && control_C_was_pressed))
+			return (control_C_was_pressed) ? -1 : 0;
+
+		if (end == NOWHERE)
+			end = window->size;
+
+		chain = page_in(window, start, end, top, &tail);
+
+		for (line = backwards ? tail : chain; line != NULL;
+								line = backwards ? line->prev : line->next) {
+			const char *found = strstrwrapper(line->data, needle, backwards ?
+								line->data + strlen(line->data) : line->data);
+#ifdef ENABLE_SPELLER
+			/* Skip the matches that are part of a longer word. */
+			while (found != NULL && whole_word_only &&
+						!is_separate_word(found - line->data, ISSET(USE_REGEXP) ?
+						regmatches[0].rm_eo - regmatches[0].rm_so : strlen(needle),
+						line->data)) {
+				if (backwards && found == line->data)
+					found = NULL;
+				else
+					found = strstrwrapper(line->data, needle, backwards ?
+								line->data + step_left(line->data, found - line->data) :
+								found + char_length(found));
+			}
+#endif
+			if (found != NULL) {
+				ssize_t number = line->lineno;
+
+				*x = found - line->data;
+				free_lines(chain);
+				return number;
+			}
+		}
+
+		free_lines(chain);
+
+		if (control_C_was_pressed)
+			return -1;
+
+		if (backwards)
+			last = top - 1;
+		else
+			first = bottom + 1;
+	}
+
+	return 0;
+}
+
+/* Look for the needle in the part of the windowed file that is not in memory:
+ * from below the window to the end of the file, and then from the start of the
+ * file to above the window -- or the other way around when searching backward.
+ * A search for whole words does not wrap around.  When found, bring the matching
+ * line into memory, return it, and point found at the match.  Otherwise, return
+ * NULL. */
+linestruct *search_outside_window(const char *needle, bool whole_word_only,
+		bool report_wrap, const char **found)
+{
+	ssize_t shift = window_shift(openfile->window);
+	ssize_t above = openfile->filetop->lineno - 1;
+	ssize_t below = openfile->filebot->lineno - shift + 1;
+	ssize_t number, last;
+	linestruct *line;
+	size_t x = 0;
+
+	install_handler_for_Ctrl_C();
+	control_C_was_pressed = FALSE;
+
+	if (!ISSET(BACKWARDS_SEARCH))
+		number = search_stretch(needle, whole_word_only, below, PTRDIFF_MAX, &x);
+	else
+		number = search_stretch(needle, whole_word_only, 1, above, &x);
+
+	/* A search for whole words stops at the end of the file. */
+	if (number == 0 && !whole_word_only) {
+		if (report_wrap)
+			statusbar(_("Search Wrapped"));
+
+		if (!ISSET(BACKWARDS_SEARCH))
+			number = search_stretch(needle, FALSE, 1, above, &x);
+		else {
+			last = last_line_number(openfile->window);
+			number = (last == 0) ? -1 : search_stretch(needle, FALSE, below, last, &x);
+		}
+	}
+
+	restore_handler_for_Ctrl_C();
+
+	/* Below the window, the lines in the buffer are numbered differently
+	 * from the lines in the file when lines were added or deleted. */
+	if (number > above)
+		number += shift;
+
+	if (number <= 0 || move_window_to(number) == NULL)
+		return NULL;
+
+	for (line = openfile->filetop; line->lineno < number && line->next != NULL;)
+		line = line->next;
+
+	*found = strstrwrapper(line->data, needle, line->data + x);
+
+	return (*found != NULL) ? line : NULL;
+}
+#endif
+
 /* Look for needle, starting at (current, current_x).  begin is the line
  * where we first started searching, at column begin_x.  Return 1 when we
  * found something, 0 when nothing, and -2 on cancel.  When match_len is
@@ -255,6 +379,14 @@ int findnextstr(const char *needle, bool whole_word_only, int modus,
 			return 0;
 		}
 
+#ifndef NANO_TINY
+		/* When the rest of the file is still arriving, wait for it. */
+		if (openfile->loader != NULL && !ISSET(BACKWARDS_SEARCH) &&
+						line->next == openfile->filebot) {
+			wait_for_lines(openfile);
+			continue;
+		}
+#endif
 		/* Move to the previous or next line in the file. */
 		if (ISSET(BACKWARDS_SEARCH))
 			line = line->prev;
@@ -264,10 +396,41 @@ int findnextstr(const char *needle, bool whole_word_only, int modus,
 		/* If we've reached the start or end of the buffer, wrap around;
 		 * but stop when spell-checking or replacing in a region. */
 		if (line == NULL) {
-			if (whole_word_only || modus == INREGION) {
+			if (modus == INREGION) {
 				enable_waiting();
 				return 0;
 			}
+#ifndef NANO_TINY
+			/* When only part of the file is in memory, search the rest too. */
+			if (openfile->window != NULL && (openfile->filetop->lineno > 1 ||
+						openfile->window->endbyte < openfile->window->size)) {
+				line = search_outside_window(needle, whole_word_only,
+												modus == JUSTFIND, &found);
+				if (line != NULL) {
+					if (ISSET(USE_REGEXP))
+						found_len = regmatches[0].rm_eo - regmatches[0].rm_so;
+					break;
+				}
+
+				if (control_C_was_pressed) {
+					statusbar(_("Cancelled"));
+					enable_waiting();
+					return -2;
+				}
+			}
+#endif
+			if (whole_word_only) {
+				enable_waiting();
+				return 0;
+			}
+#ifndef NANO_TINY
+
+			/* Before wrapping around, the whole file must be present. */
+			if (!await_loading(0)) {
+				enable_waiting();
+				return -2;
+			}
+#endif
 
 			if (ISSET(BACKWARDS_SEARCH))
 				line = openfile->filebot;
@@ -470,7 +633,7 @@ int replace_regexp(char *string, bool create)
 /* Return a copy of the current line with one needle replaced. */
 char *replace_line(const char *needle)
 {
-	size_t new_size = strlen(openfile->current->data) + 1;
+	size_t new_size = line_length(openfile->current) + 1;
 	size_t match_len;
 	char *copy;
 
@@ -595,14 +758,22 @@ ssize_t do_replace_loop(const char *needle, bool whole_word_only,
 
 		if (choice == 1 || replaceall) {  /* Yes, replace it. */
 			char *copy;
-			size_t length_change;
+			size_t length = line_length(openfile->current);
+			size_t chars = line_chars(openfile->current);
+			size_t length_change, chars_change;
 
 #ifndef NANO_TINY
 			add_undo(REPLACE, NULL);
 #endif
 			copy = replace_line(needle);
 
-			length_change = strlen(copy) - strlen(openfile->current->data);
+			length_change = strlen(copy) - length;
+
+			/* Count just the characters of the match and its replacement. */
+			chars_change = mbstrnlen(copy + openfile->current_x,
+										match_len + length_change) -
+							mbstrnlen(openfile->current->data + openfile->current_x,
+										match_len);
 
 #ifndef NANO_TINY
 			/* If the mark was on and it was located after the cursor,
@@ -643,9 +814,10 @@ ssize_t do_replace_loop(const char *needle, bool whole_word_only,
 				openfile->current_x += match_len + length_change;
 
 			/* Update the file size, and put the changed line into place. */
-			openfile->totsize += mbstrlen(copy) - mbstrlen(openfile->current->data);
-			free(openfile->current->data);
-			openfile->current->data = copy;
+			openfile->totsize += chars_change;
+			set_data(openfile->current, copy);
+			set_counts(openfile->current, length + length_change,
+										chars + chars_change);
 
 			if (!replaceall) {
 #ifdef ENABLE_COLOR
@@ -736,12 +908,34 @@ void ask_for_replacement(void)
 				"Replaced %zd occurrences", numreplaced), numreplaced);
 }
 
+/* Make the line with the given number the current line -- or the last line,
+ * when the buffer has fewer lines. */
+void go_to_line(ssize_t line)
+{
+#ifndef NANO_TINY
+	linestruct *nearby;
+
+	/* Start from the nearest indexed line -- not from the current line,
+	 * as that one may be gone. */
+	if (line >= openfile->filebot->lineno)
+		openfile->current = openfile->filebot;
+	else if ((nearby = indexed_line(line)) != NULL)
+		openfile->current = nearby;
+	else
+#endif
+		openfile->current = openfile->filetop;
+
+	while (openfile->current->lineno < line && openfile->current != openfile->filebot)
+		openfile->current = openfile->current->next;
+}
+
 /* Go to the specified line and x position. */
 void goto_line_posx(ssize_t line, size_t pos_x)
 {
-	for (openfile->current = openfile->filetop; line > 1 &&
-				openfile->current != openfile->filebot; line--)
-		openfile->current = openfile->current->next;
+#ifndef NANO_TINY
+	bring_in_line(line);
+#endif
+	go_to_line(line);
 
 	openfile->current_x = pos_x;
 	openfile->placewewant = xplustabs();
@@ -792,16 +986,26 @@ void do_gotolinecolumn(ssize_t line, ssize_t column, bool use_answer,
 			column = openfile->placewewant + 1;
 	}
 
+#ifndef NANO_TINY
+	/* When the requested line has not been read yet, wait for it. */
+	if (!await_loading(line < 0 ? 0 : line))
+		return;
+
+	/* When only part of the file is in memory, fetch the needed part. */
+	if (line < 0 && !bring_in_line(0))
+		return;
+#endif
 	/* Take a negative line number to mean: from the end of the file. */
 	if (line < 0)
 		line = openfile->filebot->lineno + line + 1;
 	if (line < 1)
 		line = 1;
 
-	/* Iterate to the requested line. */
-	for (openfile->current = openfile->filetop; line > 1 &&
-				openfile->current != openfile->filebot; line--)
-		openfile->current = openfile->current->next;
+#ifndef NANO_TINY
+	if (!bring_in_line(line))
+		return;
+#endif
+	go_to_line(line);
 
 	/* Take a negative column number to mean: from the end of the line. */
 	if (column < 0)
@@ -109,7 +109,7 @@ void indent_a_line(linestruct *line, char *indentation)
 		return;
 
 	/* Add the fabricated indentation to the beginning of the line. */
-	line->data = charealloc(line->data, length + indent_len + 1);
+	resize_data(line, length + indent_len + 1);
 	memmove(line->data + indent_len, line->data, length + 1);
 	strncpy(line->data, indentation, indent_len);
 
@@ -239,7 +239,9 @@ void unindent_a_line(linestruct *line, size_t indent_len)
 		return;
 
 	/* Remove the first tab's worth of whitespace from this line. */
+	unshare_data(line);
 	memmove(line->data, line->data + indent_len, length - indent_len + 1);
+	forget_counts(line);
 
 	openfile->totsize -= indent_len;
 
@@ -340,7 +342,7 @@ bool comment_line(undo_type action, linestruct *line, const char *comment_seq)
 	if (action == COMMENT) {
 		/* Make room for the comment sequence(s), move the text right and
 		 * copy them in. */
-		line->data = charealloc(line->data, line_len + pre_len + post_len + 1);
+		resize_data(line, line_len + pre_len + post_len + 1);
 		memmove(line->data + pre_len, line->data, line_len + 1);
 		memmove(line->data, comment_seq, pre_len);
 		if (post_len > 0)
@@ -367,9 +369,11 @@ bool comment_line(undo_type action, linestruct *line, const char *comment_seq)
 			return TRUE;
 
 		/* Erase the comment prefix by moving the non-comment part. */
+		unshare_data(line);
 		memmove(line->data, line->data + pre_len, line_len - pre_len);
 		/* Truncate the postfix if there was one. */
 		line->data[line_len - pre_len - post_len] = '\0';
+		forget_counts(line);
 
 		openfile->totsize -= pre_len + post_len;
 
@@ -503,6 +507,7 @@ void undo_cut(undostruct *u)
 void redo_cut(undostruct *u)
 {
 	linestruct *oldcutbuffer = cutbuffer;
+	linestruct *oldcutbottom = cutbottom;
 
 	goto_line_posx(u->lineno, u->begin);
 
@@ -519,6 +524,7 @@ void redo_cut(undostruct *u)
 
 	free_lines(cutbuffer);
 	cutbuffer = oldcutbuffer;
+	cutbottom = oldcutbottom;
 }
 
 /* Undo the last thing(s) we did. */
@@ -535,6 +541,9 @@ void do_undo(void)
 		return;
 	}
 
+	if (openfile->journal != NULL)
+		journal_the_undo(FALSE);
+
 	if (u->type <= REPLACE)
 		f = line_from_number(u->mark_begin_lineno);
 
@@ -550,15 +559,14 @@ void do_undo(void)
 		data = charalloc(strlen(f->data) - strlen(u->strdata) + 1);
 		strncpy(data, f->data, u->begin);
 		strcpy(&data[u->begin], &f->data[u->begin + strlen(u->strdata)]);
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		goto_line_posx(u->lineno, u->begin);
 		break;
 	case ENTER:
 		undidmsg = _("line break");
 		from_x = (u->begin == 0) ? 0 : u->mark_begin_x;
 		to_x = (u->begin == 0) ? u->mark_begin_x : u->begin;
-		f->data = charealloc(f->data, strlen(f->data) +
+		resize_data(f, strlen(f->data) +
 								strlen(&u->strdata[from_x]) + 1);
 		strcat(f->data, &u->strdata[from_x]);
 		unlink_node(f->next);
@@ -572,8 +580,7 @@ void do_undo(void)
 		strncpy(data, f->data, u->begin);
 		strcpy(&data[u->begin], u->strdata);
 		strcpy(&data[u->begin + strlen(u->strdata)], &f->data[u->begin]);
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
 		break;
 	case JOIN:
@@ -585,12 +592,10 @@ void do_undo(void)
 			goto_line_posx(openfile->filebot->lineno, 0);
 			break;
 		}
-		t = make_new_node(f);
-		t->data = copy_of(u->strdata);
+		t = make_text_node(f, u->strdata);
 		data = mallocstrncpy(NULL, f->data, u->mark_begin_x + 1);
 		data[u->mark_begin_x] = '\0';
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		splice_node(f, t);
 		renumber_from(t);
 		goto_line_posx(u->lineno, u->begin);
@@ -599,8 +604,9 @@ void do_undo(void)
 		undidmsg = _("replacement");
 		goto_line_posx(u->lineno, u->begin);
 		data = u->strdata;
-		u->strdata = f->data;
+		u->strdata = detach_data(f);
 		f->data = data;
+		forget_counts(f);
 		break;
 #ifdef ENABLE_WRAPPING
 	case SPLIT_END:
@@ -684,8 +690,9 @@ void do_undo(void)
 
 	openfile->totsize = u->wassize;
 
-	/* When at the point where the file was last saved, unset "Modified". */
-	if (openfile->current_undo == openfile->last_saved) {
+	/* When at the point where the file was last saved, unset "Modified" --
+	 * but not while replaying a journal: the lines must stay as edited. */
+	if (openfile->current_undo == openfile->last_saved && !replaying_journal) {
 		openfile->modified = FALSE;
 		titlebar(NULL);
 	} else
@@ -704,6 +711,9 @@ void do_redo(void)
 		return;
 	}
 
+	if (openfile->journal != NULL)
+		journal_the_undo(TRUE);
+
 	/* Find the item before the current one in the undo stack. */
 	while (u->next != openfile->current_undo)
 		u = u->next;
@@ -720,18 +730,15 @@ void do_redo(void)
 		strncpy(data, f->data, u->begin);
 		strcpy(&data[u->begin], u->strdata);
 		strcpy(&data[u->begin + strlen(u->strdata)], &f->data[u->begin]);
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
 		break;
 	case ENTER:
 		redidmsg = _("line break");
-		shoveline = make_new_node(f);
-		shoveline->data = copy_of(u->strdata);
+		shoveline = make_text_node(f, u->strdata);
 		data = mallocstrncpy(NULL, f->data, u->begin + 1);
 		data[u->begin] = '\0';
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		splice_node(f, shoveline);
 		renumber_from(shoveline);
 		goto_line_posx(u->lineno + 1, u->mark_begin_x);
@@ -742,8 +749,7 @@ void do_redo(void)
 		data = charalloc(strlen(f->data) + strlen(u->strdata) + 1);
 		strncpy(data, f->data, u->begin);
 		strcpy(&data[u->begin], &f->data[u->begin + strlen(u->strdata)]);
-		free(f->data);
-		f->data = data;
+		set_data(f, data);
 		goto_line_posx(u->lineno, u->begin);
 		break;
 	case JOIN:
@@ -755,7 +761,7 @@ void do_redo(void)
 			goto_line_posx(u->mark_begin_lineno, u->mark_begin_x);
 			break;
 		}
-		f->data = charealloc(f->data, strlen(f->data) + strlen(u->strdata) + 1);
+		resize_data(f, strlen(f->data) + strlen(u->strdata) + 1);
 		strcat(f->data, u->strdata);
 		unlink_node(f->next);
 		renumber_from(f);
@@ -764,8 +770,9 @@ void do_redo(void)
 	case REPLACE:
 		redidmsg = _("replacement");
 		data = u->strdata;
-		u->strdata = f->data;
+		u->strdata = detach_data(f);
 		f->data = data;
+		forget_counts(f);
 		goto_line_posx(u->lineno, u->begin);
 		break;
 #ifdef ENABLE_WRAPPING
@@ -844,8 +851,9 @@ void do_redo(void)
 
 	openfile->totsize = u->newsize;
 
-	/* When at the point where the file was last saved, unset "Modified". */
-	if (openfile->current_undo == openfile->last_saved) {
+	/* When at the point where the file was last saved, unset "Modified" --
+	 * but not while replaying a journal: the lines must stay as edited. */
+	if (openfile->current_undo == openfile->last_saved && !replaying_journal) {
 		openfile->modified = FALSE;
 		titlebar(NULL);
 	} else
@@ -856,7 +864,7 @@ void do_redo(void)
 /* Break the current line at the cursor position. */
 void do_enter(void)
 {
-	linestruct *newnode = make_new_node(openfile->current);
+	linestruct *newnode;
 	size_t extra = 0;
 #ifndef NANO_TINY
 	linestruct *sampleline = openfile->current;
@@ -879,8 +887,8 @@ void do_enter(void)
 			allblanks = TRUE;
 	}
 #endif /* NANO_TINY */
-	newnode->data = charalloc(strlen(openfile->current->data +
-										openfile->current_x) + extra + 1);
+	newnode = make_sized_node(openfile->current, extra + 1 +
+								strlen(openfile->current->data + openfile->current_x));
 	strcpy(&newnode->data[extra], openfile->current->data +
 										openfile->current_x);
 #ifndef NANO_TINY
@@ -894,7 +902,9 @@ void do_enter(void)
 #endif
 
 	/* Make the current line end at the cursor position. */
+	unshare_data(openfile->current);
 	openfile->current->data[openfile->current_x] = '\0';
+	forget_counts(openfile->current);
 
 #ifndef NANO_TINY
 	add_undo(ENTER, NULL);
@@ -909,7 +919,7 @@ void do_enter(void)
 
 	/* Insert the newly created line after the current one and renumber. */
 	splice_node(openfile->current, newnode);
-	renumber_from(newnode);
+	renumber_span(newnode, newnode);
 
 	/* Put the cursor on the new line, after any automatic whitespace. */
 	openfile->current = newnode;
@@ -1013,6 +1023,7 @@ bool execute_command(const char *command)
 	/* If the command starts with "|", pipe buffer or region to the command. */
 	if (should_pipe) {
 		linestruct *was_cutbuffer = cutbuffer;
+		linestruct *was_cutbottom = cutbottom;
 		cutbuffer = NULL;
 
 #ifdef ENABLE_MULTIBUFFER
@@ -1049,6 +1060,7 @@ bool execute_command(const char *command)
 #endif
 		free_lines(cutbuffer);
 		cutbuffer = was_cutbuffer;
+		cutbottom = was_cutbottom;
 	}
 
 	/* Re-enable interpretation of the special control keys so that we get
@@ -1085,26 +1097,32 @@ bool execute_command(const char *command)
 	return TRUE;
 }
 
+/* Free the given undo item and everything it holds. */
+void free_undo_item(undostruct *item)
+{
+	groupstruct *group = item->grouping;
+
+	free_data(item->strdata);
+	free_lines(item->cutbuffer);
+	while (group != NULL) {
+		groupstruct *next = group->next;
+		free_chararray(group->indentations,
+							group->bottom_line - group->top_line);
+		free(group);
+		group = next;
+	}
+	free(item);
+}
+
 /* Discard undo items that are newer than the given one, or all if NULL.
  * When keep is TRUE, do not touch the last_saved pointer. */
 void discard_until(const undostruct *thisitem, openfilestruct *thefile, bool keep)
 {
 	undostruct *dropit = thefile->undotop;
-	groupstruct *group;
 
 	while (dropit != NULL && dropit != thisitem) {
 		thefile->undotop = dropit->next;
-		free(dropit->strdata);
-		free_lines(dropit->cutbuffer);
-		group = dropit->grouping;
-		while (group != NULL) {
-			groupstruct *next = group->next;
-			free_chararray(group->indentations,
-								group->bottom_line - group->top_line);
-			free(group);
-			group = next;
-		}
-		free(dropit);
+		free_undo_item(dropit);
 		dropit = thefile->undotop;
 	}
 
@@ -1138,6 +1156,14 @@ void add_undo(undo_type action, const char *message)
 	u->grouping = NULL;
 	u->xflags = 0;
 
+	/* Before the stack changes, let the journal catch up with it. */
+	if (openfile->journal != NULL)
+#ifdef ENABLE_WRAPPING
+		journal_the_stack(action != SPLIT_BEGIN);
+#else
+		journal_the_stack(TRUE);
+#endif
+
 	/* Blow away any undone items. */
 	discard_until(openfile->current_undo, openfile, TRUE);
 
@@ -1469,7 +1495,7 @@ bool do_wrap(void)
 #ifndef NANO_TINY
 			add_undo(ADD, NULL);
 #endif
-			line->data = charealloc(line->data, line_len + 2);
+			resize_data(line, line_len + 2);
 			line->data[line_len] = ' ';
 			line->data[line_len + 1] = '\0';
 			rest_length++;
@@ -1521,7 +1547,7 @@ bool do_wrap(void)
 
 		line = line->next;
 		line_len = strlen(line->data);
-		line->data = charealloc(line->data, lead_len + line_len + 1);
+		resize_data(line, lead_len + line_len + 1);
 
 		memmove(line->data + lead_len, line->data, line_len + 1);
 		strncpy(line->data, line->prev->data, lead_len);
@@ -1670,8 +1696,13 @@ void copy_character(char **from, char **to)
  * number of characters untreated. */
 void squeeze(linestruct *line, size_t skip)
 {
-	char *start = line->data + skip;
-	char *from = start, *to = start;
+	char *start, *from, *to;
+
+	unshare_data(line);
+
+	start = line->data + skip;
+	from = start;
+	to = start;
 
 	/* For each character, 1) when a blank, change it to a space, and pass over
 	 * all blanks after it; 2) if it is punctuation, copy it plus a possible
@@ -1710,6 +1741,7 @@ void squeeze(linestruct *line, size_t skip)
 		to--;
 
 	*to = '\0';
+	forget_counts(line);
 }
 
 /* Return the length of the quote part of the given line.  The "quote part"
@@ -1822,12 +1854,12 @@ void concat_paragraph(linestruct **line, size_t par_len)
 		/* We're just about to tack the next line onto this one.  If
 		 * this line isn't empty, make sure it ends in a space. */
 		if (line_len > 0 && (*line)->data[line_len - 1] != ' ') {
-			(*line)->data = charealloc((*line)->data, line_len + 2);
+			resize_data(*line, line_len + 2);
 			(*line)->data[line_len++] = ' ';
 			(*line)->data[line_len] = '\0';
 		}
 
-		(*line)->data = charealloc((*line)->data,
+		resize_data(*line,
 								line_len + next_line_len - next_lead_len + 1);
 		strcat((*line)->data, next_line->data + next_lead_len);
 
@@ -1860,8 +1892,8 @@ void rewrap_paragraph(linestruct **line, char *lead_string, size_t lead_len)
 
 		/* Insert a new line after the current one, and copy the leading part
 		 * plus the text after the breaking point into it. */
-		splice_node(*line, make_new_node(*line));
-		(*line)->next->data = charalloc(lead_len + line_len - break_pos + 1);
+		splice_node(*line, make_sized_node(*line,
+								lead_len + line_len - break_pos + 1));
 		strncpy((*line)->next->data, lead_string, lead_len);
 		strcpy((*line)->next->data + lead_len, (*line)->data + break_pos);
 
@@ -1873,7 +1905,9 @@ void rewrap_paragraph(linestruct **line, char *lead_string, size_t lead_len)
 		}
 
 		/* Now actually break the current line, and go to the next. */
+		unshare_data(*line);
 		(*line)->data[break_pos] = '\0';
+		forget_counts(*line);
 		*line = (*line)->next;
 	}
 
@@ -1933,6 +1967,8 @@ void do_justify(bool full_justify)
 		/* The bottom x-coordinate of the paragraph we justify. */
 	linestruct *was_cutbuffer = cutbuffer;
 		/* The old cutbuffer, so we can justify in the current cutbuffer. */
+	linestruct *was_cutbottom = cutbottom;
+		/* The last line of the old cutbuffer. */
 	linestruct *jusline;
 		/* The line that we're justifying in the current cutbuffer. */
 
@@ -2071,7 +2107,7 @@ void do_justify(bool full_justify)
 		 * has a leading part, prepend any missing portion of this leading part
 		 * to the first line of the extracted region. */
 		if (needed_top_extra > 0) {
-			cutbuffer->data = charealloc(cutbuffer->data,
+			resize_data(cutbuffer,
 									line_len + needed_top_extra + 1);
 			memmove(cutbuffer->data + needed_top_extra, cutbuffer->data,
 									line_len + 1);
@@ -2086,10 +2122,13 @@ void do_justify(bool full_justify)
 		indent_len = indent_length(cutbuffer->data + lead_len);
 
 		/* Remove extra whitespace after the leading part. */
-		if (indent_len > 0)
+		if (indent_len > 0) {
+			unshare_data(cutbuffer);
 			memmove(cutbuffer->data + lead_len,
 						cutbuffer->data + lead_len + indent_len,
 						line_len - indent_len + 1);
+			forget_counts(cutbuffer);
+		}
 
 		/* If the marked region ends in the middle of a line, and this line
 		 * has a leading part, check if the last line of the extracted region
@@ -2113,12 +2152,13 @@ void do_justify(bool full_justify)
 		 * the middle of the line's leading part, no new line is needed: just
 		 * remove the (now-redundant) addition we made earlier. */
 		if (top_x > 0) {
-			if (needed_top_extra > 0)
+			if (needed_top_extra > 0) {
+				unshare_data(cutbuffer);
 				memmove(cutbuffer->data, cutbuffer->data + needed_top_extra,
 							strlen(cutbuffer->data) - needed_top_extra + 1);
-			else {
-				cutbuffer->prev = make_new_node(NULL);
-				cutbuffer->prev->data = copy_of("");
+				forget_counts(cutbuffer);
+			} else {
+				cutbuffer->prev = make_text_node(NULL, "");
 				cutbuffer->prev->next = cutbuffer;
 				cutbuffer = cutbuffer->prev;
 			}
@@ -2130,8 +2170,7 @@ void do_justify(bool full_justify)
 		 * portion, so it will become a full leading part when the justified
 		 * region is "pasted" back. */
 		if (bot_x > 0 && !ends_at_eol) {
-			line->next = make_new_node(line);
-			line->next->data = copy_of(the_lead + needed_bot_extra);
+			line->next = make_text_node(line, the_lead + needed_bot_extra);
 		}
 
 		free(the_lead);
@@ -2180,6 +2219,7 @@ void do_justify(bool full_justify)
 
 	/* We're done justifying.  Restore the old cutbuffer. */
 	cutbuffer = was_cutbuffer;
+	cutbottom = was_cutbottom;
 
 	/* Show what we justified on the status bar. */
 #ifndef NANO_TINY
@@ -2929,6 +2969,13 @@ void do_linter(void)
 			while (openfile != started_at && (openfile->current_stat == NULL ||
 						openfile->current_stat->st_ino != lintfileinfo.st_ino))
 				openfile = openfile->next;
+#ifndef NANO_TINY
+			/* A buffer that was packed while idle needs its lines back. */
+			if (openfile->packed != NULL) {
+				unpack_buffer();
+				prepare_for_display();
+			}
+#endif
 
 			if (openfile->current_stat == NULL ||
 						openfile->current_stat->st_ino != lintfileinfo.st_ino) {
@@ -162,12 +162,10 @@ bool parse_line_column(const char *str, ssize_t *line, ssize_t *column)
 /* In the given string, recode each embedded NUL as a newline. */
 void unsunder(char *string, size_t length)
 {
-	while (length > 0) {
-		if (*string == '\0')
-			*string = '\n';
-		length--;
-		string++;
-	}
+	char *tail = string + length;
+
+	while ((string = memchr(string, '\0', tail - string)) != NULL)
+		*string++ = '\n';
 }
 
 /* In the given string, recode each embedded newline as a NUL. */
@@ -424,8 +422,12 @@ size_t breadth(const char *text)
 /* Append a new magic line to the end of the buffer. */
 void new_magicline(void)
 {
-	openfile->filebot->next = make_new_node(openfile->filebot);
-	openfile->filebot->next->data = copy_of("");
+#ifndef NANO_TINY
+	/* When more of a huge file follows, its last line is not in memory. */
+	if (openfile->window != NULL && openfile->window->endbyte < openfile->window->size)
+		return;
+#endif
+	openfile->filebot->next = make_text_node(openfile->filebot, "");
 	openfile->filebot = openfile->filebot->next;
 	openfile->totsize++;
 }
@@ -435,6 +437,10 @@ void new_magicline(void)
  * it isn't the only line in the file. */
 void remove_magicline(void)
 {
+#ifndef NANO_TINY
+	if (openfile->window != NULL && openfile->window->endbyte < openfile->window->size)
+		return;
+#endif
 	if (openfile->filebot->data[0] == '\0' &&
 				openfile->filebot != openfile->filetop) {
 		openfile->filebot = openfile->filebot->prev;
@@ -491,10 +497,128 @@ void get_range(const linestruct **top, const linestruct **bot)
 	}
 }
 
+/* Make the line index of the current buffer reach the given entry, walking
+ * on from its last valid entry.  Return FALSE when the buffer does not have
+ * that many lines, or when its lines are not numbered from the top. */
+bool extend_index(size_t entry)
+{
+	linestruct *line;
+
+	if (entry < openfile->indexed)
+		return TRUE;
+
+	if (entry >= openfile->indexroom) {
+		openfile->indexroom = entry + entry / 2 + 64;
+		openfile->lineindex = nrealloc(openfile->lineindex,
+								openfile->indexroom * sizeof(linestruct *));
+		openfile->stridechars = nrealloc(openfile->stridechars,
+								openfile->indexroom * sizeof(size_t));
+		openfile->charsums = nrealloc(openfile->charsums,
+								(openfile->indexroom + 1) * sizeof(size_t));
+	}
+
+	if (openfile->indexed == 0) {
+		if (openfile->filetop->lineno != 1)
+			return FALSE;
+		openfile->lineindex[openfile->indexed++] = openfile->filetop;
+	}
+
+	line = openfile->lineindex[openfile->indexed - 1];
+
+	while (openfile->indexed <= entry) {
+		for (int step = 0; step < INDEXSTRIDE; step++) {
+			if (line->next == NULL)
+				return FALSE;
+			line = line->next;
+		}
+
+		if (line->lineno != (ssize_t)(openfile->indexed * INDEXSTRIDE + 1))
+			return FALSE;
+
+		openfile->lineindex[openfile->indexed++] = line;
+	}
+
+	return TRUE;
+}
+
+/* Discard the character counts of the given stride and of the ones after it. */
+void forget_sums_from(openfilestruct *buffer, size_t stride)
+{
+	if (stride < buffer->summed)
+		buffer->summed = stride;
+
+	if (buffer->stale >= (ssize_t)buffer->summed)
+		buffer->stale = -1;
+}
+
+/* Discard the entries of the line index that refer to the line with the
+ * given number or to lines after it, in the buffer that ends with the given
+ * line -- if there is such a buffer: the lines could be some other list. */
+void forget_index_from(const linestruct *bottom, ssize_t number)
+{
+	openfilestruct *buffer = openfile;
+	size_t keep = (number < 2) ? 0 : (number - 2) / INDEXSTRIDE + 1;
+
+	if (buffer == NULL)
+		return;
+
+#ifdef ENABLE_MULTIBUFFER
+	while (buffer->filebot != bottom) {
+		buffer = buffer->next;
+		if (buffer == openfile)
+			return;
+	}
+#else
+	if (buffer->filebot != bottom)
+		return;
+#endif
+
+	if (keep < buffer->indexed)
+		buffer->indexed = keep;
+
+	/* The stride that holds the given line is no longer complete. */
+	forget_sums_from(buffer, (number < 1) ? 0 : (number - 1) / INDEXSTRIDE);
+}
+
+/* When the given line (which is going away) is in the line index of the
+ * current buffer, discard its entry and the ones after it. */
+void unindex_line(const linestruct *line)
+{
+	size_t entry;
+
+	if (openfile == NULL || openfile->indexed == 0 || line->lineno < 1)
+		return;
+
+	entry = (line->lineno - 1) / INDEXSTRIDE;
+
+	if (entry < openfile->indexed && openfile->lineindex[entry] == line) {
+		openfile->indexed = entry;
+		forget_sums_from(openfile, entry);
+	}
+}
+
+/* Return the line in the index that is nearest before the line with the
+ * given number, or NULL when the index cannot tell. */
+linestruct *indexed_line(ssize_t number)
+{
+	size_t entry = (number - 1) / INDEXSTRIDE;
+
+	/* When only a part of a huge file is in memory, there is no index. */
+	if (openfile->window != NULL || number < 1 || !extend_index(entry))
+		return NULL;
+
+	return openfile->lineindex[entry];
+}
+
 /* Return a pointer to the line that has the given line number. */
 linestruct *line_from_number(ssize_t number)
 {
 	linestruct *line = openfile->current;
+	linestruct *nearby = indexed_line(number);
+
+	/* Start from the indexed line, unless the current line is nearer. */
+	if (nearby != NULL && (line->lineno < nearby->lineno || line->lineno > number))
+		line = nearby;
 
 	if (line->lineno > number)
 		while (line->lineno != number)
@@ -505,17 +629,110 @@ linestruct *line_from_number(ssize_t number)
 
 	return line;
 }
+
+/* Note that the text of the given line of the current buffer has changed,
+ * so the character count of the stride that holds it is off.  When some
+ * other stride was off already, just drop the counts from the first. */
+void mark_stride(const linestruct *line)
+{
+	size_t stride;
+
+	if (openfile == NULL || line->lineno < 1)
+		return;
+
+	stride = (line->lineno - 1) / INDEXSTRIDE;
+
+	if (stride >= openfile->summed || openfile->stale == (ssize_t)stride)
+		return;
+
+	if (openfile->stale < 0)
+		openfile->stale = stride;
+	else
+		forget_sums_from(openfile, (openfile->stale < (ssize_t)stride) ?
+										(size_t)openfile->stale : stride);
+}
+
+/* Count the characters (newlines included) in the given stride of lines. */
+size_t count_stride(size_t stride)
+{
+	linestruct *line = openfile->lineindex[stride];
+	size_t count = 0;
+
+	for (int step = 0; step < INDEXSTRIDE; step++) {
+		count += line_chars(line) + 1;
+		line = line->next;
+	}
+
+	return count;
+}
+
+/* Add the given amount to the count of the given stride in the tree. */
+void add_to_sums(size_t stride, ssize_t amount)
+{
+	for (size_t i = stride + 1; i <= openfile->summed; i += i & -i)
+		openfile->charsums[i] += amount;
+}
+
+/* Return the number of characters before the given line -- the sum of the
+ * counted strides above it plus the lines of its own stride before it. */
+size_t chars_before(linestruct *line)
+{
+	size_t stride = (line->lineno - 1) / INDEXSTRIDE;
+	linestruct *item;
+	size_t sum = 0;
+	int steps = 0;
+
+	if (line == openfile->filetop)
+		return 0;
+
+	if (openfile->window != NULL || line->lineno < 1 || !extend_index(stride))
+		return get_totsize(openfile->filetop, line->prev);
+
+	/* First bring the count of a changed stride up to date. */
+	if (openfile->stale >= 0) {
+		size_t count = count_stride(openfile->stale);
+
+		add_to_sums(openfile->stale,
+						(ssize_t)count - (ssize_t)openfile->stridechars[openfile->stale]);
+		openfile->stridechars[openfile->stale] = count;
+		openfile->stale = -1;
+	}
+
+	/* Then count the strides that were not counted yet, and hang each one
+	 * into the tree, together with the elements that its element spans. */
+	while (openfile->summed < stride) {
+		size_t i = ++openfile->summed;
+
+		openfile->stridechars[i - 1] = count_stride(i - 1);
+		openfile->charsums[i] = openfile->stridechars[i - 1];
+
+		for (size_t span = 1; span < (i & -i); span <<= 1)
+			openfile->charsums[i] += openfile->charsums[i - span];
+	}
+
+	for (size_t i = stride; i > 0; i -= i & -i)
+		sum += openfile->charsums[i];
+
+	for (item = openfile->lineindex[stride]; item != line; item = item->next) {
+		/* When the line is not where its number says, give up on the index. */
+		if (item == NULL || ++steps == INDEXSTRIDE)
+			return get_totsize(openfile->filetop, line->prev);
+		sum += line_chars(item) + 1;
+	}
+
+	return sum;
+}
 #endif /* !NANO_TINY */
 
 /* Count the number of characters from begin to end, and return it. */
-size_t get_totsize(const linestruct *begin, const linestruct *end)
+size_t get_totsize(linestruct *begin, linestruct *end)
 {
-	const linestruct *line;
+	linestruct *line;
 	size_t totsize = 0;
 
 	/* Sum the number of characters (plus a newline) in each line. */
 	for (line = begin; line != end->next; line = line->next)
-		totsize += mbstrlen(line->data) + 1;
+		totsize += line_chars(line) + 1;
 
 	/* The last line of a file doesn't have a newline -- otherwise it
 	 * wouldn't be the last line -- so subtract 1 when at EOF. */
@@ -524,3 +741,153 @@ size_t get_totsize(const linestruct *begin, const linestruct *end)
 
 	return totsize;
 }
+
+/* Return the number of characters from (top, top_x) to (bot, bot_x) in the
+ * current buffer.  For a region of many lines whose strides have been counted
+ * already, take the number from those counts instead of from the lines. */
+size_t region_size(linestruct *top, size_t top_x, linestruct *bot, size_t bot_x)
+{
+	size_t size;
+
+	if (top == bot)
+		return mbstrnlen(top->data + top_x, bot_x - top_x);
+
+#ifndef NANO_TINY
+	if (openfile->window == NULL && openfile->unnumbered == NULL &&
+				bot->lineno - top->lineno > 2 * INDEXSTRIDE &&
+				(size_t)(bot->lineno - 1) / INDEXSTRIDE < openfile->summed)
+		size = chars_before(bot) - chars_before(top);
+	else
+#endif
+		size = get_totsize(top, bot->prev);
+
+	return size - mbstrnlen(top->data, top_x) + mbstrnlen(bot->data, bot_x);
+}
+
+#ifndef NANO_TINY
+/* The number of bits of the hash of four bytes, and the shortest match. */
+#define PACKHASHBITS 12
+#define MINMATCH 4
+
+/* Write at the given spot one sequence of the packed format: a token with
+ * the number of literal bytes and of matched bytes, the literals themselves,
+ * and (when there is a match) its distance back.  Return the size written. */
+size_t put_sequence(unsigned char *spot, const char *literals, size_t count,
+		size_t distance, size_t length)
+{
+	unsigned char *out = spot;
+	size_t extra = (length > 0) ? length - MINMATCH : 0;
+
+	*out++ = ((count < 15 ? count : 15) << 4) | (extra < 15 ? extra : 15);
+
+	/* Counts of fifteen or more continue in the bytes after the token. */
+	if (count >= 15) {
+		size_t rest = count - 15;
+
+		for (; rest >= 255; rest -= 255)
+			*out++ = 255;
+		*out++ = rest;
+	}
+
+	memcpy(out, literals, count);
+	out += count;
+
+	if (length > 0) {
+		*out++ = distance & 0xFF;
+		*out++ = distance >> 8;
+
+		if (extra >= 15) {
+			size_t rest = extra - 15;
+
+			for (; rest >= 255; rest -= 255)
+				*out++ = 255;
+			*out++ = rest;
+		}
+	}
+
+	return out - spot;
+}
+
+/* Compress the given text (of at most PACKBLOCK bytes) in the manner of LZ4:
+ * as a series of literal stretches, each followed by a back reference to an
+ * earlier occurrence of the bytes that come next.  The packed form is put in
+ * the given room, which must hold size + size / 255 + 16 bytes.  Return the
+ * size of the packed form. */
+size_t pack_text(const char *text, size_t size, char *packed)
+{
+	unsigned short seen[1 << PACKHASHBITS];
+		/* Where a group of four bytes with a given hash was seen last. */
+	unsigned char *out = (unsigned char *)packed;
+	size_t anchor = 0, here = 0;
+
+	memset(seen, 0, sizeof(seen));
+
+	while (here + MINMATCH <= size) {
+		unsigned int quad, slot;
+		size_t earlier, length;
+
+		memcpy(&quad, text + here, MINMATCH);
+		slot = (quad * 2654435761u) >> (32 - PACKHASHBITS);
+		earlier = seen[slot];
+		seen[slot] = here;
+
+		if (earlier >= here || memcmp(text + earlier, text + here, MINMATCH) != 0) {
+			here++;
+			continue;
+		}
+
+		for (length = MINMATCH; here + length < size; length++)
+			if (text[earlier + length] != text[here + length])
+				break;
+
+		out += put_sequence(out, text + anchor, here - anchor, here - earlier, length);
+		here += length;
+		anchor = here;
+	}
+
+	/* The last sequence consists of literals only. */
+	out += put_sequence(out, text + anchor, size - anchor, 0, 0);
+
+	return out - (unsigned char *)packed;
+}
+
+/* Decompress the given packed form (of the given size) into the given text,
+ * which must have room for all the bytes that were packed. */
+void unpack_text(const char *packed, size_t size, char *text)
+{
+	const unsigned char *in = (const unsigned char *)packed;
+	const unsigned char *end = in + size;
+	char *out = text;
+
+	while (in < end) {
+		size_t count = *in >> 4;
+		size_t length = (*in++ & 15) + MINMATCH;
+		const char *from;
+
+		if (count == 15)
+			do
+				count += *in;
+			while (*in++ == 255);
+
+		memcpy(out, in, count);
+		out += count;
+		in += count;
+
+		/* The last sequence has no back reference. */
+		if (in == end)
+			break;
+
+		from = out - (in[0] | (in[1] << 8));
+		in += 2;
+
+		if (length == 15 + MINMATCH)
+			do
+				length += *in;
+			while (*in++ == 255);
+
+		/* The match may overlap the bytes that it produces. */
+		while (length-- > 0)
+			*out++ = *from++;
+	}
+}
+#endif /* !NANO_TINY */
@@ -176,6 +176,11 @@ void read_keys_from(WINDOW *win)
 {
 	int input = ERR;
 	size_t errcount = 0;
+#ifndef NANO_TINY
+	bool lagging = FALSE;
+	bool idling = FALSE;
+	int delay = -1;
+#endif
 
 	/* Before reading the first keycode, display any pending screen updates. */
 	doupdate();
@@ -189,6 +194,26 @@ void read_keys_from(WINDOW *win)
 
 	/* Read in the first keycode using whatever mode we're in. */
 	while (input == ERR) {
+#ifndef NANO_TINY
+		/* While some file is still being read or is being followed,
+		 * look regularly for new lines.  While some journal lags behind,
+		 * come back in a while to write it out.  And while some buffer
+		 * is not yet packed, come back in a while to see if it is idle. */
+		if (waiting_mode) {
+			lagging = ISSET(JOURNAL) && tend_journals();
+#ifdef ENABLE_MULTIBUFFER
+			idling = (compress_after > 0 && currmenu == MMAIN && pack_idle_buffers());
+#endif
+			delay = (files_loading > 0 || files_followed > 0) ? 100 :
+								(lagging || idling) ? 1000 : -1;
+			wtimeout(win, delay);
+		}
+
+		/* When files are being watched, wait also for news about them. */
+		if (waiting_mode && watcher >= 0 && !await_input(delay))
+			input = ERR;
+		else
+#endif
 		input = wgetch(win);
 
 #ifndef NANO_TINY
@@ -196,6 +221,30 @@ void read_keys_from(WINDOW *win)
 			regenerate_screen();
 			input = KEY_WINCH;
 		}
+
+		/* When the file of the current buffer changed, and nano is waiting
+		 * for a command, get out, so that the change can be reported. */
+		if (input == ERR && waiting_mode && watcher >= 0 && spot_changes() &&
+						currmenu == MMAIN)
+			input = KEY_FILECHANGE;
+
+		if (input == ERR && waiting_mode && (lagging || idling || watcher >= 0) &&
+						files_loading == 0 && files_followed == 0)
+			continue;
+
+		if (input == ERR && waiting_mode && (files_loading > 0 || files_followed > 0)) {
+			if (files_loading > 0)
+				take_in_all_lines();
+			if (files_followed > 0)
+				take_in_all_growth();
+			if (currmenu == MMAIN && refresh_needed) {
+				edit_refresh();
+				if (reveal_cursor)
+					curs_set(1);
+			}
+			doupdate();
+			continue;
+		}
 #endif
 		if (input == ERR && !waiting_mode) {
 			curs_set(0);
@@ -219,7 +268,7 @@ void read_keys_from(WINDOW *win)
 
 #ifndef NANO_TINY
 	/* If we got a SIGWINCH, get out as the win argument is no longer valid. */
-	if (input == KEY_WINCH)
+	if (input == KEY_WINCH || input == KEY_FILECHANGE)
 		return;
 #endif
 
@@ -1578,8 +1627,8 @@ int *parse_verbatim_kbinput(WINDOW *win, size_t *count)
 		;
 
 #ifndef NANO_TINY
-	/* When the window was resized, abort and return nothing. */
-	if (*kbinput == KEY_WINCH) {
+	/* When the window was resized or the file changed, abort and return nothing. */
+	if (*kbinput == KEY_WINCH || *kbinput == KEY_FILECHANGE) {
 		free(kbinput);
 		*count = 0;
 		return NULL;
@@ -3361,7 +3410,6 @@ void total_refresh(void)
  * suppress_cursorpos is FALSE.  In any case, reset the latter. */
 void do_cursorpos(bool force)
 {
-	char saved_byte;
 	size_t sum, cur_xpt = xplustabs() + 1;
 	size_t cur_lenpt = breadth(openfile->current->data) + 1;
 	int linepct, colpct, charpct;
@@ -3373,22 +3421,41 @@ void do_cursorpos(bool force)
 	}
 
 	/* Determine the size of the file up to the cursor. */
-	saved_byte = openfile->current->data[openfile->current_x];
-	openfile->current->data[openfile->current_x] = '\0';
-
-	sum = get_totsize(openfile->filetop, openfile->current);
-
-	openfile->current->data[openfile->current_x] = saved_byte;
-
-	/* When not at EOF, subtract 1 for an overcounted newline. */
-	if (openfile->current != openfile->filebot)
-		sum--;
+	sum = mbstrnlen(openfile->current->data, openfile->current_x);
+#ifndef NANO_TINY
+	sum += chars_before(openfile->current);
+#else
+	if (openfile->current != openfile->filetop)
+		sum += get_totsize(openfile->filetop, openfile->current->prev);
+#endif
 
 	/* Display the current cursor position on the statusbar. */
 	linepct = 100 * openfile->current->lineno / openfile->filebot->lineno;
 	colpct = 100 * cur_xpt / cur_lenpt;
 	charpct = (openfile->totsize == 0) ? 0 : 100 * sum / openfile->totsize;
 
+#ifndef NANO_TINY
+	/* When only part of the file is in memory, report just lines and columns. */
+	if (openfile->window != NULL) {
+		ssize_t count = windowed_linecount(openfile->window);
+
+		if (count > 0)
+			statusline(HUSH, _("line %zd/%zd (%d%%), col %zu/%zu (%d%%)"),
+				openfile->current->lineno, count,
+				(int)(100 * openfile->current->lineno / count),
+				cur_xpt, cur_lenpt, colpct);
+		else
+			statusline(HUSH, _("line %zd/%zd+, col %zu/%zu (%d%%)"),
+				openfile->current->lineno, openfile->filebot->lineno,
+				cur_xpt, cur_lenpt, colpct);
+	} else
+	/* While the file is still being read, the totals are not yet known. */
+	if (openfile->loader != NULL)
+		statusline(HUSH, _("line %zd/%zd+, col %zu/%zu (%d%%), char %zu/%zu+"),
+				openfile->current->lineno, openfile->filebot->lineno - 1,
+				cur_xpt, cur_lenpt, colpct, sum, openfile->totsize);
+	else
+#endif
 	statusline(HUSH,
 		_("line %zd/%zd (%d%%), col %zu/%zu (%d%%), char %zu/%zu (%d%%)"),
 		openfile->current->lineno, openfile->filebot->lineno, linepct,